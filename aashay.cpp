@@ -2,6 +2,12 @@
 #include <cmath>
 #include <fstream>
 #include <vector>
+#include <cstring>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
 
 #include <GL/glew.h>
 #include <GL/gl.h>
@@ -12,19 +18,24 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
-using namespace std;
+#include "hud.h"
+#include "mesh.h"
+#include "level.h"
+#include "pack.h"
+#include "rules.h"
+#include "watch.h"
+#include "triple.h"
+#include "runlog.h"
+#include "game.h"
+#include "editor.h"
+#include "feed.h"
 
-struct VAO {
-	GLuint VertexArrayID;
-	GLuint VertexBuffer;
-	GLuint ColorBuffer;
+using namespace std;
 
-	GLenum PrimitiveMode;
-	GLenum FillMode;
-	int NumVertices;
-};
-typedef struct VAO VAO;
-int initLevel();
+void initLevel();
+void stopSim();
+void closeRunLog();
+void closeFeed();
 struct GLMatrices {
 	glm::mat4 projection;
 	glm::mat4 model;
@@ -32,6 +43,7 @@ struct GLMatrices {
 	GLuint MatrixID;
 } Matrices;
 int x = 0;
+bool gpuStatsOn = false;
 int do_rot, floor_rel;;
 GLuint programID;
 int last_update_time, current_time;
@@ -122,6 +134,13 @@ static void error_callback(int error, const char* description)
 
 void quit(GLFWwindow *window)
 {
+	stopSim();
+	closeRunLog();
+	closeFeed();
+	hudStop();
+	if (gpuStatsOn)
+		printGpuStats(stderr);
+	destroyMeshes();
 	if(x == 1)
 	{
 		printf("CONGRATULATIONS! YOU HAVE COMPLETED THE GAME\n");
@@ -144,100 +163,70 @@ void initGLEW(void){
 
 
 
-/* Generate VAO, VBOs and return VAO handle */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL)
-{
-	struct VAO* vao = new struct VAO;
-	vao->PrimitiveMode = primitive_mode;
-	vao->NumVertices = numVertices;
-	vao->FillMode = fill_mode;
-
-    // Create Vertex Array Object
-    // Should be done after CreateWindow and before any other GL calls
-    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
-    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
-    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
-
-    glBindVertexArray (vao->VertexArrayID); // Bind the VAO 
-    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
-    glVertexAttribPointer(
-                          0,                  // attribute 0. Vertices
-                          3,                  // size (x,y,z)
-                          GL_FLOAT,           // type
-                          GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
-                          );
-
-    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors 
-    glBufferData (GL_ARRAY_BUFFER, 3*numVertices*sizeof(GLfloat), color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
-    glVertexAttribPointer(
-                          1,                  // attribute 1. Color
-                          3,                  // size (r,g,b)
-                          GL_FLOAT,           // type
-                          GL_FALSE,           // normalized?
-                          0,                  // stride
-                          (void*)0            // array buffer offset
-                          );
-
-    return vao;
-}
-
-/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
-struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL)
-{
-	GLfloat* color_buffer_data = new GLfloat [3*numVertices];
-	for (int i=0; i<numVertices; i++) {
-		color_buffer_data [3*i] = red;
-		color_buffer_data [3*i + 1] = green;
-		color_buffer_data [3*i + 2] = blue;
-	}
-
-	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, color_buffer_data, fill_mode);
-}
-
-/* Render the VBOs handled by VAO */
-void draw3DObject (struct VAO* vao)
-{
-    // Change the Fill Mode for this object
-	glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
-
-    // Bind the VAO to use
-	glBindVertexArray (vao->VertexArrayID);
-
-    // Enable Vertex Attribute 0 - 3d Vertices
-	glEnableVertexAttribArray(0);
-    // Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
-
-    // Enable Vertex Attribute 1 - Color
-	glEnableVertexAttribArray(1);
-    // Bind the VBO to use
-	glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
-
-    // Draw the geometry !
-    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
-}
-
 /**************************
  * Customizable functions *
  **************************/
 
+/* Simulation ticks per second, independent of the display refresh */
+#define SIM_HZ 120
+
 float camera_angle = 0;
-float xpos = 0, ypos = 0, blockz =  0;
-int orientation = 0, falling = 0, switchOn = 1;
+// Game state, owned by the simulation thread once it runs
+GameState game;
+int level =1;
+bool gameOver = false;
+unsigned boardVersion = 0;	// bumped whenever game.board is replaced
+// Timing of the attempt in progress, for the run log
+RunLog *runLog;
+std::chrono::system_clock::time_point runStart;
+std::chrono::steady_clock::time_point runClock;
+std::chrono::steady_clock::time_point fellAt;	// the fatal roll, logged once the fall plays out
+bool runLogged;
+// Spectator feed (--spectate), rewritten every tick
+SpectateFeed *feed;
+// Render thread state
 int viewMode = 0;
-bool updir = false, downdir = false, leftdir = false, rightdir = false;
 bool changeView = false, mouseLeft = false;
 double mouse_x, mouse_y, pressx, pressy;
-int level =1;
 int lastkey = 1;
-int moves = 0,win=0;
-struct baseStruct
-{
-	int type;
-} base[20][20];
+int hudFormat = HUD_FORMAT_STATUS;
+bool hudWindow = false;
+std::vector<LevelEntry> manifest;
+LevelLoader *loader;
+LevelWatcher *watcher;
+// Level editor (--edit): cells are clicked on the render thread and cycled
+// by the simulation thread, which owns the board
+EditSolver *editSolver;
+std::mutex editLock;
+std::vector<int> editCells;
+double clickx, clicky;
+bool editShown;		// the optimal move count for the latest edit went out
+int shownOptimal = -2;	// that count (-1 can't be won) for the window title, -2 for none
+
+/* Arrow keys pressed but not yet played, one bit per DIR_* */
+std::atomic<unsigned> pendingDirs(0);
+/* Undos less redos pressed but not yet played, and a restart request */
+std::atomic<int> pendingUndo(0);
+std::atomic<bool> pendingRestart(false);
+/* Tab presses not yet played; each hands over to the other cube of a split block */
+std::atomic<int> pendingSwaps(0);
+
+/* Everything the renderer needs from one simulation tick. Snapshots are
+ * never modified once published; the board is shared, not copied. */
+struct Snapshot {
+	float xpos, ypos, blockz;
+	float xpos2, ypos2;		// the other cube when split
+	int orientation;
+	uint32_t switchMask;
+	unsigned boardVersion;
+	std::shared_ptr<const Level> board;
+	int level, moves;
+	int optimal;			// shownOptimal
+	bool over;
+};
+TripleBuffer<Snapshot> snapshots;
+std::thread simThread;
+std::atomic<bool> simRunning(false);
 
 /* Executed when a regular key is pressed/released/held-down */
 /* Prefered for Keyboard events */
@@ -245,54 +234,44 @@ void keyboard (GLFWwindow* window, int key, int scancode, int action, int mods)
 {
     // Function is called first on GLFW_PRESS.
 
-	if (action == GLFW_RELEASE) {
-		switch (key) {
-			case GLFW_KEY_UP:
-			updir = false;
-			break;
-			case GLFW_KEY_DOWN:
-			downdir = false;
-			break;
-			case GLFW_KEY_LEFT:
-			leftdir = false;
-			break;
-			case GLFW_KEY_RIGHT:
-			rightdir = false;
-			break;
-			default:
-			break;
-		}
-	}
-	else if (action == GLFW_PRESS) {
+	// Moves are queued for the simulation thread, which plays them on its next tick
+	if (action == GLFW_PRESS) {
 		switch (key) {
 			case GLFW_KEY_ESCAPE:
 			quit(window);
 			break;
 			case GLFW_KEY_UP:
-			updir = true;
+			pendingDirs.fetch_or(1u << DIR_UP);
 			lastkey = 1;
-			moves++;
 			break;
 			case GLFW_KEY_DOWN:
-			downdir = true;
+			pendingDirs.fetch_or(1u << DIR_DOWN);
 			lastkey = 2; 
-			moves++;
 			break;
 			case GLFW_KEY_LEFT:
-			leftdir = true;
+			pendingDirs.fetch_or(1u << DIR_LEFT);
 			lastkey = 3;
-			moves++;
-
 			break;
 			case GLFW_KEY_RIGHT:
-			rightdir = true;
-
-			moves++;
+			pendingDirs.fetch_or(1u << DIR_RIGHT);
 			lastkey = 4;
 			break;
 			case GLFW_KEY_SPACE:
 			changeView = true;
 			break;
+			case GLFW_KEY_TAB:
+			pendingSwaps.fetch_add(1);
+			break;
+			case GLFW_KEY_Z:
+			case GLFW_KEY_BACKSPACE:
+			pendingUndo.fetch_add(1);
+			break;
+			case GLFW_KEY_Y:
+			pendingUndo.fetch_sub(1);
+			break;
+			case GLFW_KEY_R:
+			pendingRestart.store(true);
+			break;
 			default:
 			break;
 		}
@@ -312,6 +291,29 @@ void keyboardChar (GLFWwindow* window, unsigned int key)
 	}
 }
 
+/* Board cell under the cursor, -1 if none: a ray through the last frame's
+ * camera, met with the plane of the tile tops at z = 0 */
+int pickCell (GLFWwindow* window, double x, double y)
+{
+	int width, height, fbwidth, fbheight;
+	glfwGetWindowSize(window, &width, &height);
+	glfwGetFramebufferSize(window, &fbwidth, &fbheight);
+	glm::vec4 viewport(0, 0, fbwidth, fbheight);
+	glm::vec3 cursor(x * fbwidth / width, fbheight - y * fbheight / height, 0);
+	glm::vec3 from = glm::unProject(cursor, Matrices.view, Matrices.projection, viewport);
+	cursor.z = 1;
+	glm::vec3 to = glm::unProject(cursor, Matrices.view, Matrices.projection, viewport);
+	if (from.z == to.z)
+		return -1;
+	float t = from.z / (from.z - to.z);
+	if (t < 0 || t > 1)
+		return -1;
+	glm::vec3 hit = from + t * (to - from);
+	const Level &board = *snapshots.front().board;
+	int row = board.originY - (int)floorf(hit.y), col = board.originX - (int)floorf(hit.x);
+	return board.inside(row, col) ? row*board.width + col : -1;
+}
+
 /* Executed when a mouse button is pressed/released */
 void mouseButton (GLFWwindow* window, int button, int action, int mods)
 {
@@ -320,10 +322,21 @@ void mouseButton (GLFWwindow* window, int button, int action, int mods)
 		if (action == GLFW_RELEASE)
 		{
 			mouseLeft=false;
+			// A click that didn't drag the camera edits the cell under it
+			double x, y;
+			glfwGetCursorPos(window, &x, &y);
+			int cell = editSolver && fabs(x - clickx) < 4 && fabs(y - clicky) < 4 ? pickCell(window, x, y) : -1;
+			if (cell >= 0)
+			{
+				std::lock_guard<std::mutex> guard(editLock);
+				editCells.push_back(cell);
+			}
 		}
 		if (action == GLFW_PRESS)
 		{
 			glfwGetCursorPos(window, &pressx, &pressy);
+			clickx = pressx;
+			clicky = pressy;
 			mouseLeft=true;
 		}
 		break;
@@ -353,7 +366,7 @@ void reshapeWindow (GLFWwindow* window, int width, int height)
     //Matrices.projection = glm::ortho(-4.0f, 4.0f, -4.0f, 4.0f, 0.1f, 500.0f);
 }
 
-VAO *block[3], *cam, *floor_vao, *solidBase, *fragileBase, *switchBase[2], *bridgeBase, *goal;
+VAO *block[3], *cube, *cam, *floor_vao, *solidBase, *fragileBase, *switchBase[2], *bridgeBase, *goal, *splitBase;
 
 void createFragileBase()
 {
@@ -667,6 +680,8 @@ void createSolidBase()
 	};
 
 	solidBase = create3DObject(GL_TRIANGLES, 12*3, vertex_buffer_data, color_buffer_data, GL_FILL);
+	// Split tiles are the same slab in one colour
+	splitBase = create3DObject(GL_TRIANGLES, 12*3, vertex_buffer_data, (float)255/255, (float)160/255, (float)40/255, GL_FILL);
 }
 
 void createSwitchBase()
@@ -1245,278 +1260,309 @@ void createVerBlock()
 	};
 
 	block[0] = create3DObject(GL_TRIANGLES, 12*3, vertex_buffer_data, color_buffer_data, GL_FILL);
+	// The cube of a split block that isn't moving, drawn at half height like the other
+	cube = create3DObject(GL_TRIANGLES, 12*3, vertex_buffer_data, (float)120/255, (float)120/255, (float)130/255, GL_FILL);
 }
-int checkBase(int x, int y)
+static_assert(RUN_SWAP == DIR_SWAP, "the run log takes the game's move log as it is");
+/* Append the attempt in progress, ended at end, to the run log, once */
+void logRun(int outcome, std::chrono::steady_clock::time_point end)
 {
-	if ( x > 4.0 || y > 4.0)
-	{
-		falling = 1;
-
-		return 0;
-	}
-	if (base[(int)(4-y)][(int)(4-x)].type == 0)
-	{
-		falling = 1;
-
-		return 0;
-	}
-	if (base[(int)(4-y)][(int)(4-x)].type == 4 && switchOn == 0)
-	{
-		falling = 1;
-
-		return 0;
-	}
-	if (base[(int)(4-y)][(int)(4-x)].type == 3)
-		return 1;
-	return 0;
+	if (runLogged)
+		return;
+	runLogged = true;
+	if (!runLog)
+		return;
+	uint64_t start = std::chrono::duration_cast<std::chrono::nanoseconds>(runStart.time_since_epoch()).count();
+	uint64_t duration = std::chrono::duration_cast<std::chrono::nanoseconds>(end - runClock).count();
+	runLog->append(level, outcome, start, duration, game.moveLog);
 }
-void checkBlock()
+
+/* Called once the simulation thread is stopped */
+void closeRunLog()
 {
-	if (falling)
+	if (!runLog)
 		return;
-	int switchCheck = 0;
-	if (orientation == 0)
-	{
-		if (base[(int)(4-ypos)][(int)(4-xpos)].type == 2)
-		{
-			falling = 1;
-
-			return;
-		}
-		switchCheck = checkBase(xpos, ypos);
-	}
-	if(orientation ==0 && base[(int)(4-ypos)][(int)(4-xpos)].type == 5)
-	{
-		falling = 1;
-		win = 1;
-	}
-
-	else if (orientation == 1)
-	{
-		switchCheck += checkBase(xpos, ypos);
-		switchCheck += checkBase(xpos+1, ypos);
-	}
-	else if (orientation == 2)
-	{
-		switchCheck += checkBase(xpos, ypos);
-		switchCheck += checkBase(xpos, ypos+1);
-	}
+	if (!gameOver && game.falling)
+		logRun(RUN_FELL, fellAt);
+	else if (!gameOver && !game.moveLog.empty())
+		logRun(RUN_QUIT, std::chrono::steady_clock::now());
+	delete runLog;
+	runLog = NULL;
+}
 
-	if (switchCheck > 0)
-	{
-		if(switchOn)
-			switchOn=0;
-		else
-			switchOn=1;
-	}
+/* Start a new attempt on board */
+void resetBlock(const std::shared_ptr<const Level> &board)
+{
+	// Keys pressed while falling don't carry over to the next attempt
+	pendingDirs.store(0);
+	pendingSwaps.store(0);
+	gameStart(game, board, level);
+	runStart = std::chrono::system_clock::now();
+	runClock = std::chrono::steady_clock::now();
+	runLogged = false;
 }
-int initLevel()
+
+void initLevel()
 {
-	moves=0;
-	win=0;
-	falling = 0;
-	FILE * file;
-	char c;
-	switch (level) {
-		case 1:
-		file = fopen("level01.txt", "r");
-		break;
-		case 2:
-		file = fopen("level04.txt", "r");
-		break;
-		case 3:
-		file = fopen("level10.txt", "r");
-		break;
-		case 4:
-		file = fopen("level03.txt", "r");
-		break;
-		default:
-		file = fopen("level09.txt", "r");
-		break;
+	// Normally already parsed by the loader thread while the last level was played.
+	// The old board stays alive until the renderer lets go of its snapshot.
+	std::shared_ptr<Level> next = std::make_shared<Level>();
+	if (!loader->take(level-1, *next))
+	{
+		fprintf(stderr, "Failed to load level %d\n", level);
+		exit(EXIT_FAILURE);
 	}
-	int flag=0;
-	for(int i=0;i<10;i++)
+	boardVersion++;
+	loader->prefetch(level);
+	if (watcher)
+		watcher->setCurrent(level-1);
+	if (editSolver)
 	{
-		for(int j=0;j<20;j++)
-		{
-			c = getc(file);
-			if(c=='-')
-				base[i][j].type = 0;
-			else if(c=='o')
-				base[i][j].type = 1;
-			else if(c=='S')
-			{
-				base[i][j].type = 1;
-				ypos=4-i;
-				xpos=4-j;
-				checkBlock();
-			}
-			else if(c=='T')
-				base[i][j].type = 5;
-			else if(c=='.')
-				base[i][j].type = 2;
-			else if(c=='h' || c=='s')
-			{
-				base[i][j].type = 3;
-			}
-			else if(c=='H' || c=='B')
-				base[i][j].type = 4;
-			else if(c == '\n' || c == EOF)
-			{
-				if(c==EOF) flag=1; break;
-			}
-		}
-		if(flag) break;
+		editLevel(*next);
+		editSolver->reset(next);
+		editShown = false;
 	}
+	shownOptimal = -2;
+	resetBlock(next);
+	hudPost(HUD_LEVEL_START, level, game.moves(), glfwGetTime());
 }
 
 
 
 
+/* Next queued direction, or -1. Like the old per-key flags, up wins over
+ * down over left over right when several are pending. */
+int takeInput()
+{
+	unsigned dirs = pendingDirs.load(std::memory_order_acquire);
+	if (!dirs)
+		return -1;
+	int dir = __builtin_ctz(dirs);
+	pendingDirs.fetch_and(~(1u << dir));
+	return dir;
+}
+
+/* After a roll or redo: a win ends the run there and then, a fall only
+ * once it has played out, since until then it can be undone */
+void rolled()
+{
+	if (game.won)
+		logRun(RUN_WON, std::chrono::steady_clock::now());
+	else if (game.falling)
+		fellAt = std::chrono::steady_clock::now();
+}
+
 void moveBlock()
 {
-	if (falling)
+	if (gameOver)
+		return;
+	// Restarting reuses the board in memory; nothing is reloaded
+	if (pendingRestart.exchange(false) && !game.won)
 	{
-		blockz -= 0.023;
-		if(blockz < -2)
+		if (game.falling)
+			logRun(RUN_FELL, fellAt);
+		else if (!game.moveLog.empty())
+			logRun(RUN_QUIT, std::chrono::steady_clock::now());
+		resetBlock(game.board);
+		return;
+	}
+	// Undo also catches a block that is falling off the board
+	int undo = pendingUndo.exchange(0);
+	for (; undo > 0 && gameUndo(game); undo--)
+		;
+	for (; undo < 0 && gameRedo(game); undo++)
+		rolled();
+	if (game.falling)
+	{
+		if (gameFall(game, 1.0f / SIM_HZ))
 		{
+			if (!game.won)
+				logRun(RUN_FELL, fellAt);
+			// The editor keeps trying the board being edited
+			if (editSolver)
+			{
+				resetBlock(game.board);
+				return;
+			}
 			level++;
-			if(level>5)
+			if(level>(int)manifest.size())
 			{
 				x=1;
 			}
-			blockz=0;
-			orientation=0;
-			if(win)
+			hudPost(game.won ? HUD_LEVEL_WON : HUD_LEVEL_FAILED, level-1, game.moves(), glfwGetTime());
+			if(game.won && level <= (int)manifest.size())
 				initLevel();
 			else
 			{
-				cout << endl<<"-------------------------------------"<<endl;
-				if(x == 1)
-				{
-					printf("CONGRATULATIONS! YOU HAVE COMPLETED THE GAME\n");
-				}
-				else
-					printf("\n GAME OVER! BETTER LUCK NEXT TIME :p\n");
-				exit(1);
+				// The render thread sees this in the snapshot and shuts down
+				if (!game.won)
+					hudPost(HUD_GAME_OVER, level-1, game.moves(), glfwGetTime());
+				gameOver = true;
 			}
 		}
 		return;
 	}
-	int moved = 0;
-	if(orientation==0)
-	{
-		if(updir)
-		{
-			ypos += 1;
-			orientation = 2;
-			moved=1;
-			updir = false;
-		}
-		else if(downdir)
-		{
-			ypos -= 2;
-			orientation = 2;
-			moved=1;
-			downdir = false;
-		}
-		else if(leftdir)
-		{
-			xpos -= 2;
-			orientation = 1;
-			moved=1;
-			leftdir = false;
-		}
-		else if(rightdir)
-		{
-			xpos += 1;
-			orientation = 1;
-			moved=1;
-			rightdir = false;
-		}
-		if (moved)
-			checkBlock();
+	// Tab pressed twice in a tick hands over and back again
+	if (pendingSwaps.exchange(0) & 1)
+		gameSwap(game);
+	// Only rolls count as moves; keys pressed while falling or loading never get here
+	int dir = takeInput();
+	if (dir < 0)
+		return;
+	gameRoll(game, dir);
+	rolled();
+}
 
+/* Cycle the cells clicked since the last tick on a copy of the board, so
+ * the renderer's snapshot never changes under it, and report the optimal
+ * move count once it is known for the new board */
+void applyEdits()
+{
+	std::vector<int> cells;
+	{
+		std::lock_guard<std::mutex> guard(editLock);
+		cells.swap(editCells);
 	}
-	else if(orientation==1)
+	if (!cells.empty())
 	{
-		if(updir)
-		{
-			ypos += 1;
-			orientation = 1;
-			moved=1;
-			updir = false;
-		}
-		else if(downdir)
-		{
-			ypos -= 1;
-			orientation = 1;
-			moved=1;
-			downdir = false;
-		}
-		else if(leftdir)
-		{
-			xpos -= 1;
-			orientation = 0;
-			moved=1;
-			leftdir = false;
-		}
-		else if(rightdir)
-		{
-			xpos += 2;
-			orientation = 0;
-			moved=1;
-			rightdir = false;
-		}
-		if (moved)
-			checkBlock();
+		std::shared_ptr<Level> edited = std::make_shared<Level>(*game.board);
+		for (size_t i=0; i<cells.size(); i++)
+			cycleTile(*edited, cells[i]);
+		// Bridges that just came into being start extended
+		if (!game.board->groups && edited->groups)
+			game.mask = edited->startMask;
+		// The block may have been standing on a cell that is now empty
+		gameSetBoard(game, edited);
+		if (game.falling)
+			fellAt = std::chrono::steady_clock::now();
+		boardVersion++;
+		editSolver->edited(edited, cells);
+		editShown = false;
+	}
+	int optimal;
+	if (!editShown && editSolver->result(&optimal))
+	{
+		editShown = true;
+		shownOptimal = optimal;
+		hudPost(HUD_LEVEL_EDITED, level, optimal, glfwGetTime());
+	}
+}
+
+/* Hand the current state to spectators; never waits on them */
+void publishFeed()
+{
+	SpectateState s;
+	s.level = level;
+	s.row = game.row;
+	s.col = game.col;
+	s.orientation = game.orientation;
+	s.row2 = game.row2;
+	s.col2 = game.col2;
+	s.mask = game.mask;
+	s.moves = game.moves();
+	s.boardVersion = boardVersion;
+	s.flags = (game.falling ? FEED_FALLING : 0) | (game.won ? FEED_WON : 0) | (gameOver ? FEED_OVER : 0);
+	s.time = (uint64_t)(glfwGetTime() * 1e9);
+	feed->publish(s);
+}
+
+/* Tells spectators the game is gone; called once the simulation thread is stopped */
+void closeFeed()
+{
+	delete feed;
+	feed = NULL;
+}
 
+/* Hand the current state to the render thread */
+void publishSnapshot()
+{
+	Snapshot &s = snapshots.back();
+	s.xpos = game.worldX();
+	s.ypos = game.worldY();
+	s.xpos2 = game.worldX2();
+	s.ypos2 = game.worldY2();
+	s.blockz = game.blockz;
+	s.orientation = game.orientation;
+	s.switchMask = game.mask;
+	if (s.boardVersion != boardVersion || !s.board)
+	{
+		s.board = game.board;
+		s.boardVersion = boardVersion;
 	}
-	else if(orientation==2)
+	s.level = level;
+	s.moves = game.moves();
+	s.optimal = shownOptimal;
+	s.over = gameOver;
+	snapshots.publish();
+	if (feed)
+		publishFeed();
+}
+
+/* One simulation tick: input, physics, level swaps and the status HUD.
+ * Only this thread posts to the HUD queue, which is single-producer. */
+void tick()
+{
+	moveBlock();
+
+	// Swap in a level the designer just saved; the camera is left alone
+	static std::shared_ptr<Level> reloaded;
+	int optimal;
+	double reloadMs;
+	if (watcher && !reloaded)
+		reloaded = std::make_shared<Level>();
+	if (watcher && watcher->poll(*reloaded, &optimal, &reloadMs))
 	{
-		if(updir)
-		{
-			ypos += 2;
-			orientation = 0;
-			moved=1;
-			updir = false;
-		}
-		else if(downdir)
-		{
-			ypos -= 1;
-			orientation = 0;
-			moved=1;
-			downdir = false;
-		}
-		else if(leftdir)
-		{
-			xpos -= 1;
-			orientation = 2;
-			moved=1;
-			leftdir = false;
-		}
-		else if(rightdir)
+		boardVersion++;
+		if (editSolver)
 		{
-			xpos += 1;
-			orientation = 2;
-			moved=1;
-			rightdir = false;
+			editLevel(*reloaded);
+			editSolver->reset(reloaded);
+			editShown = false;
 		}
-		if (moved)
-			checkBlock();
+		resetBlock(reloaded);
+		reloaded.reset();
+		shownOptimal = optimal;
+		hudPost(HUD_LEVEL_RELOADED, level, optimal, glfwGetTime(), reloadMs);
 	}
+
+	if (editSolver)
+		applyEdits();
+
+	// Status only goes out when it changes, and never blocks on stdout
+	hudStatus(level, game.moves(), glfwGetTime());
+	publishSnapshot();
 }
 
-void defineBase()
+/* Fixed-rate simulation loop. After a stall (a slow synchronous level load)
+ * it resynchronises instead of running a burst of catch-up ticks. */
+void simulate()
 {
-	string str="11111111112222221111131111111111114444411111111111111111115555";
-	int si=str.size(),i;
+	const double period = 1.0 / SIM_HZ;
+	double next = glfwGetTime();
+	while (simRunning.load(std::memory_order_acquire))
+	{
+		tick();
+		next += period;
+		double now = glfwGetTime();
+		if (next < now - 0.25)
+			next = now;
+		else if (next > now)
+			std::this_thread::sleep_for(std::chrono::duration<double>(next - now));
+	}
+}
 
-	for (i=0; i<si; i++)
-		base[i/10][i%10].type = (int)(str[i]-'0');
+void startSim()
+{
+	publishSnapshot();
+	simRunning.store(true);
+	simThread = std::thread(simulate);
+}
 
-	for(i; i<400; i++)
-		base[i/10][1%10].type = 0;
+void stopSim()
+{
+	if (!simRunning.exchange(false))
+		return;
+	simThread.join();
 }
 
 void chooseView()
@@ -1526,6 +1572,27 @@ void chooseView()
 	changeView = false;
 }
 
+/* Draw view.board->tiles[first, last) */
+void drawTiles (const glm::mat4 &VP, const Snapshot &view, size_t first, size_t last, VAO **tileMesh)
+{
+	glm::mat4 MVP;
+	for (size_t i=first; i<last; i++)
+	{
+		const TileDraw &t = view.board->tiles[i];
+		VAO *mesh = tileMesh[t.type];
+		// Switches show whether the groups they toggle are extended
+		if (tileKinds[t.type].mesh == MESH_SWITCH)
+			mesh = switchBase[(t.groups & view.switchMask) != 0];
+		if (!mesh)
+			continue;
+		Matrices.model = glm::mat4(1.0f);
+		Matrices.model *= (glm::translate (glm::vec3(t.x,t.y,0)));
+		MVP = VP * Matrices.model;
+		glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+		draw3DObject(mesh);
+	}
+}
+
 /* Render the scene with openGL */
 /* Edit this function according to your assignment */
 void draw (GLFWwindow* window, float x, float y, float w, float h) //, int doM, int doV, int doP)
@@ -1538,11 +1605,11 @@ void draw (GLFWwindow* window, float x, float y, float w, float h) //, int doM,
     // use the loaded shader program
     // Don't change unless you know what you are doing
 	glUseProgram(programID);
+	// Newest state from the simulation thread, fetched once per frame in main()
+	const Snapshot &view = snapshots.front();
 
 	glm::vec3 eye, target, up;
 	chooseView();
-	if(level > 5)
-		quit(window);
 	if (viewMode == 0)
 	{
         //tower 
@@ -1581,83 +1648,83 @@ void draw (GLFWwindow* window, float x, float y, float w, float h) //, int doM,
 	else if (viewMode == 3)
 	{
         //BLOCK VIEW
-		if (orientation == 0)
+		if (view.orientation == 0 || view.orientation == ORIENT_SPLIT)
 		{
 			if (lastkey == 1)
 			{
-				eye = glm::vec3(xpos + 0.5, ypos+1, 1);
+				eye = glm::vec3(view.xpos + 0.5, view.ypos+1, 1);
 				target = glm::vec3(0, 1000, -500);
 				up = glm::vec3(0, 1, 1000);
 			}
 			else if (lastkey == 2)
 			{
-				eye = glm::vec3(xpos + 0.5, ypos, 1);
+				eye = glm::vec3(view.xpos + 0.5, view.ypos, 1);
 				target = glm::vec3(0, -1000, -500);
 				up = glm::vec3(0, 1, 1000);
 			}
 			else if (lastkey == 3)
 			{
-				eye = glm::vec3(xpos, ypos+0.5, 1);
+				eye = glm::vec3(view.xpos, view.ypos+0.5, 1);
 				target = glm::vec3(-1000, 0, -500);
 				up = glm::vec3(1, 0, 1000);
 			}
 			else if (lastkey == 4)
 			{
-				eye = glm::vec3(xpos + 1, ypos + 0.5, 1);
+				eye = glm::vec3(view.xpos + 1, view.ypos + 0.5, 1);
 				target = glm::vec3(1000, 0, -500);
 				up = glm::vec3(1, 0, 1000);
 			}
 		}
-		else if (orientation == 1)
+		else if (view.orientation == 1)
 		{
 			if (lastkey == 1)
 			{
-				eye = glm::vec3(xpos + 1, ypos + 1, 3);
+				eye = glm::vec3(view.xpos + 1, view.ypos + 1, 3);
 				target = glm::vec3(0, 1000, -500);
 				up = glm::vec3(0, 1, 1000);
 			}
 			else if (lastkey == 2)
 			{
-				eye = glm::vec3(xpos + 1, ypos, 1);
+				eye = glm::vec3(view.xpos + 1, view.ypos, 1);
 				target = glm::vec3(0, -1000, -500);
 				up = glm::vec3(0, 1, 1000);
 			}
 			else if (lastkey == 3)
 			{
-				eye = glm::vec3(xpos, ypos + 0.5, 1);
+				eye = glm::vec3(view.xpos, view.ypos + 0.5, 1);
 				target = glm::vec3(-1000, 0, -500);
 				up = glm::vec3(1, 0, 1000);
 			}
 			else if (lastkey == 4)
 			{
-				eye = glm::vec3(xpos + 2, ypos + 0.5, 1);
+				eye = glm::vec3(view.xpos + 2, view.ypos + 0.5, 1);
 				target = glm::vec3(1000, 0, -500);
 				up = glm::vec3(1, 0, 1000);
 			}
 		}
-		else if (orientation == 2)
+		else if (view.orientation == 2)
 		{
 			if (lastkey == 1)
 			{
-				eye = glm::vec3(xpos + 0.5, ypos + 2, 3);
+				eye = glm::vec3(view.xpos + 0.5, view.ypos + 2, 3);
 				target = glm::vec3(0, 1000, -500);
 				up = glm::vec3(0, 1, 1000);
 			}
 			else if (lastkey == 2)
 			{
-				eye = glm::vec3(xpos + 0.5, ypos, 3);
+				eye = glm::vec3(view.xpos + 0.5, view.ypos, 3);
 				target = glm::vec3(0, -1000, -500);
 				up = glm::vec3(0, 1, 1000);
 			}
 			else if (lastkey == 3)
 			{
-				eye = glm::vec3(xpos, ypos + 1, 3);
+				eye = glm::vec3(view.xpos, view.ypos + 1, 3);
 				target = glm::vec3(-1000, 0, -500);
 				up = glm::vec3(1, 0, 1000);
 			}
 			else if (lastkey == 4)
 			{
-				eye = glm::vec3(xpos + 1, ypos + 1, 3);
+				eye = glm::vec3(view.xpos + 1, view.ypos + 1, 3);
 				target = glm::vec3(1000, 0, -500);
 				up = glm::vec3(1, 0, 1000);
 			}
@@ -1667,7 +1734,7 @@ void draw (GLFWwindow* window, float x, float y, float w, float h) //, int doM,
 	else if (viewMode == 4)
 	{
         //flow
-		eye = glm::vec3(xpos+5, ypos, 2.5);
+		eye = glm::vec3(view.xpos+5, view.ypos, 2.5);
 		target = glm::vec3(-1000, 0, 0);
 		up = glm:: vec3(0, 1, 100);
 	}
@@ -1678,38 +1745,43 @@ void draw (GLFWwindow* window, float x, float y, float w, float h) //, int doM,
 
     glm::mat4 MVP;	// MVP = Projection * View * Model
 
-    moveBlock();
-    Matrices.model = glm::mat4(1.0f);
-    Matrices.model *= (glm::translate (glm::vec3(xpos, ypos, blockz)));
-    MVP = VP * Matrices.model;
-    glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    draw3DObject(block[orientation]);
-
-    for (int i=0; i<10; i++)
+    if (view.orientation == ORIENT_SPLIT)
+    {
+    	// Two cubes, the standing block squashed to half height; the one Tab
+    	// hands over to is greyed out
+    	Matrices.model = glm::translate(glm::vec3(view.xpos, view.ypos, view.blockz)) * glm::scale(glm::vec3(1, 1, 0.5f));
+    	MVP = VP * Matrices.model;
+    	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    	draw3DObject(block[0]);
+    	Matrices.model = glm::translate(glm::vec3(view.xpos2, view.ypos2, view.blockz)) * glm::scale(glm::vec3(1, 1, 0.5f));
+    	MVP = VP * Matrices.model;
+    	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    	draw3DObject(cube);
+    }
+    else
     {
-    	for (int j=0; j<20; j++)
-    	{
-    		if (base[i][j].type > 0)
-    		{
-    			Matrices.model = glm::mat4(1.0f);
-    			Matrices.model *= (glm::translate (glm::vec3(4-j,4-i,0)));
-    			MVP = VP * Matrices.model;
-    			glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
-    		}
-    		if (base[i][j].type == 1)
-    			draw3DObject(solidBase);
-    		else if (base[i][j].type == 2)
-    			draw3DObject(fragileBase);
-    		else if (base[i][j].type == 3)
-    			draw3DObject(switchBase[switchOn]);
-    		else if (base[i][j].type == 4 && switchOn)
-    			draw3DObject(bridgeBase);
-    		else if(base[i][j].type == 5 )
-    		{
-    			draw3DObject(goal);
-    		}
-    	}
+    	Matrices.model = glm::mat4(1.0f);
+    	Matrices.model *= (glm::translate (glm::vec3(view.xpos, view.ypos, view.blockz)));
+    	MVP = VP * Matrices.model;
+    	glUniformMatrix4fv(Matrices.MatrixID, 1, GL_FALSE, &MVP[0][0]);
+    	draw3DObject(block[view.orientation]);
     }
+
+    // Mesh per tile kind; NULL skips the tile
+    VAO *meshes[MESH_COUNT] = { NULL, solidBase, fragileBase, NULL, bridgeBase, goal, splitBase };
+    VAO *tileMesh[TILE_KINDS];
+    for (int k=0; k<TILE_KINDS; k++)
+    	tileMesh[k] = meshes[tileKinds[k].mesh];
+
+    // Tiles come pre-sorted by type from the level compiler, no grid scan.
+    // Bridges sit in one range per group and only extended groups are drawn.
+    const Level &board = *view.board;
+    const std::vector<int> &groupFirst = board.groupFirst;
+    drawTiles(VP, view, 0, groupFirst[0], tileMesh);
+    for (int g=0; g<board.groups; g++)
+    	if (view.switchMask >> g & 1)
+    		drawTiles(VP, view, groupFirst[g], groupFirst[g+1], tileMesh);
+    drawTiles(VP, view, groupFirst[board.groups], board.tiles.size(), tileMesh);
 }
 
 /* Initialise glfw window, I/O callbacks and the renderer to use */
@@ -1755,7 +1827,6 @@ void initGL (GLFWwindow* window, int width, int height)
     // Create the models
 	createFragileBase();
 	createSolidBase();
-	// defineBase();
 	initLevel();
 	createVerBlock();
 	createXBlock();
@@ -1789,14 +1860,99 @@ int main (int argc, char** argv)
 	floor_pos = glm::vec3(0, 0, 0);
 	do_rot = 0;
 	floor_rel = 1;
+	const char *packPath = NULL;
+	const char *runLogPath = "runs.dat";
+	const char *feedName = NULL;
+	bool watchLevels = false, editLevels = false;
+	game.history.setCapacity(1024 + 1);	// undo reaches back capacity-1 moves
+
+	for (int i=1; i<argc; i++)
+	{
+		if (!strncmp(argv[i], "--hud=", 6))
+		{
+			hudFormat = hudParseFormat(argv[i]+6);
+			hudWindow = !strcmp(argv[i]+6, "window");
+		}
+		else if (!strcmp(argv[i], "--gpu-stats"))
+			gpuStatsOn = true;
+		else if (!strcmp(argv[i], "--watch"))
+			watchLevels = true;
+		else if (!strcmp(argv[i], "--edit"))
+			editLevels = true;
+		else if (!strncmp(argv[i], "--pack=", 7))
+			packPath = argv[i]+7;
+		else if (!strncmp(argv[i], "--runlog=", 9))
+			runLogPath = argv[i]+9;
+		else if (!strncmp(argv[i], "--undo=", 7))
+			game.history.setCapacity(std::max(0, atoi(argv[i]+7)) + 1);
+		else if (!strcmp(argv[i], "--spectate"))
+			feedName = FEED_DEFAULT_NAME;
+		else if (!strncmp(argv[i], "--spectate=", 11))
+			feedName = argv[i]+11;
+	}
+	hudStart(hudFormat);
+	if (feedName)
+	{
+		feed = new SpectateFeed;
+		if (!feed->open(feedName))
+		{
+			delete feed;
+			feed = NULL;
+		}
+	}
+	// Attempts on a board being edited aren't runs of the level
+	if (editLevels)
+		editSolver = new EditSolver;
+	else if (strcmp(runLogPath, "none"))
+	{
+		runLog = new RunLog;
+		if (!runLog->open(runLogPath))
+		{
+			delete runLog;
+			runLog = NULL;
+		}
+	}
+
+	if (packPath)
+	{
+		// Play every level of a binary pack, in pack order
+		LevelPack pack;
+		if (!pack.open(packPath))
+			exit(EXIT_FAILURE);
+		for (int i=0; i<pack.count(); i++)
+		{
+			char file[1024];
+			snprintf(file, sizeof(file), "%s:%d", packPath, i);
+			LevelEntry e;
+			e.file = file;
+			e.name = file;
+			e.par = 0;
+			manifest.push_back(e);
+		}
+	}
+	else if (!loadManifest("manifest.txt", manifest))
+		defaultManifest(manifest);
+	loader = new LevelLoader(manifest);
+	if (watchLevels)
+	{
+		watcher = new LevelWatcher(manifest);
+		if (!watcher->start())
+		{
+			delete watcher;
+			watcher = NULL;
+		}
+	}
 
 	GLFWwindow* window = initGLFW(width, height);
 	initGLEW();
 	initGL (window, width, height);
+	startSim();
 
 	last_update_time = glfwGetTime();
     /* Draw in loop */
-	cout << "_____________________________________"<<endl;
+	if (hudFormat == HUD_FORMAT_STATUS)
+		cout << "_____________________________________"<<endl;
+	int titleLevel = -1, titleMoves = -1, titleTime = -1, titleOptimal = -2;
 	while (!glfwWindowShouldClose(window)) {
 
 	// clear the color and depth in the frame buffer
@@ -1807,16 +1963,47 @@ int main (int argc, char** argv)
 		if(camera_angle > 720)
 			camera_angle -= 720;
 		last_update_time = current_time;
+
+		snapshots.update();
+		const Snapshot &view = snapshots.front();
+		if (view.over)
+		{
+			cout << endl<<"-------------------------------------"<<endl;
+			quit(window);
+		}
 		draw(window, 0, 0, 1, 1);
         // Swap Frame Buffer in double buffering
 		glfwSwapBuffers(window);
 
         // Poll for Keyboard and mouse events
 		glfwPollEvents();
-		std::cout << '\r'
-		<< "||" << "TIME = "<< current_time  << "||" << "  "
-		<<"||"<< "NUMBER OF MOVES = " << moves <<"||"<< std::flush;
+
+		if (hudWindow && (view.level != titleLevel || view.moves != titleMoves || current_time != titleTime
+			|| view.optimal != titleOptimal))
+		{
+			char title[128];
+			int n = snprintf(title, sizeof(title), "Bloxorz | Level %d | Time %d | Moves %d", view.level, current_time, view.moves);
+			if (view.optimal >= 0)
+				snprintf(title + n, sizeof(title) - n, " | Optimal %d", view.optimal);
+			else if (view.optimal == -1)
+				snprintf(title + n, sizeof(title) - n, " | Can't be won");
+			glfwSetWindowTitle(window, title);
+			titleLevel = view.level;
+			titleMoves = view.moves;
+			titleTime = current_time;
+			titleOptimal = view.optimal;
+		}
 	}
 
+	stopSim();
+	closeRunLog();
+	closeFeed();
+	hudStop();
+	delete editSolver;
+	delete watcher;
+	delete loader;
+	if (gpuStatsOn)
+		printGpuStats(stderr);
+	destroyMeshes();
 	glfwTerminate();
 }
@@ -0,0 +1,345 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ctime>
+
+#include "level.h"
+#include "rules.h"
+#include "solver.h"
+#include "env.h"
+#include "obs.h"
+
+/* Microbenchmarks for the parts of the game that don't need a display:
+ * the move step, support checks, parsing, compiling, building the per-frame
+ * tile list and solving, for every level of the manifest.
+ *
+ *   bench [-t seconds] [-m manifest] [filter]
+ *
+ * Each benchmark repeats until it has run for at least -t seconds (0.2 by
+ * default); only names containing filter are run. Results go to stdout as
+ * JSON, one object per benchmark with ns_per_op and items_per_second. */
+
+typedef std::chrono::steady_clock Clock;
+
+static double minTime = 0.2;
+static const char *filter = NULL;
+static bool firstResult = true;
+
+/* Keeps results alive so the compiler can't drop the measured work */
+static volatile uint64_t sink;
+
+/* Small deterministic generator, so runs are comparable */
+static uint32_t rngState = 2463534242u;
+static uint32_t rng()
+{
+	rngState ^= rngState << 13;
+	rngState ^= rngState >> 17;
+	rngState ^= rngState << 5;
+	return rngState;
+}
+
+/* One pass of a benchmark: does the work for one op and returns the
+ * number of items it processed */
+struct Bench {
+	virtual ~Bench() {}
+	virtual uint64_t run() = 0;
+};
+
+static void report(const std::string &name, uint64_t ops, uint64_t items, double seconds)
+{
+	printf("%s\n    {\"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.3f, \"items_per_second\": %.1f}",
+		firstResult ? "" : ",", name.c_str(), (unsigned long long)ops,
+		seconds*1e9/ops, items/seconds);
+	firstResult = false;
+	fflush(stdout);
+}
+
+/* Doubles the batch until a batch takes minTime, then reports that batch */
+static void measure(const std::string &name, Bench &b)
+{
+	if (filter && !strstr(name.c_str(), filter))
+		return;
+	b.run();	// warm caches and lazy allocations
+	for (uint64_t batch=1; ; batch *= 2)
+	{
+		uint64_t items = 0;
+		Clock::time_point start = Clock::now();
+		for (uint64_t i=0; i<batch; i++)
+			items += b.run();
+		double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		if (seconds >= minTime || batch >= (1ull << 40))
+		{
+			report(name, batch, items, seconds);
+			return;
+		}
+	}
+}
+
+/* Random walk over the transition table, back to the start on a fall or win.
+ * One op is 1024 steps. */
+struct StepBench : Bench {
+	const Level &level;
+	std::vector<uint8_t> dirs;
+	StateKey key;
+	unsigned offset;
+	StepBench(const Level &l) : level(l), dirs(4096), key(startState(l)), offset(0)
+	{
+		for (size_t i=0; i<dirs.size(); i++)
+			dirs[i] = rng() & 3;
+	}
+	uint64_t run()
+	{
+		StateKey start = startState(level);
+		StateKey k = key;
+		for (int i=0; i<1024; i++)
+		{
+			StateKey to;
+			k = stepState(level, k, dirs[(offset + i) & 4095], &to) == REST_OK ? to : start;
+		}
+		key = k;
+		// Start somewhere else in the direction table so every op walks a different path
+		offset += 1021;
+		sink += k;
+		return 1024;
+	}
+};
+
+/* restBlock on random in-board poses, what checkBlock() does after a roll.
+ * One op is 1024 checks. */
+struct RestBench : Bench {
+	const Level &level;
+	std::vector<int> poses;
+	RestBench(const Level &l) : level(l), poses(1024)
+	{
+		for (size_t i=0; i<poses.size(); i++)
+			poses[i] = rng() % level.wholePoses();
+	}
+	uint64_t run()
+	{
+		uint64_t sum = 0;
+		for (size_t i=0; i<poses.size(); i++)
+		{
+			int p = poses[i];
+			uint32_t toggle;
+			sum += restBlock(level, p/3/level.width, p/3%level.width, p%3, level.startMask, &toggle) + toggle;
+		}
+		sink += sum;
+		return poses.size();
+	}
+};
+
+/* parseLevel on the level file; items are cells */
+struct ParseBench : Bench {
+	std::string file;
+	ParseBench(const std::string &f) : file(f) {}
+	uint64_t run()
+	{
+		Level l;
+		if (!parseLevel(file.c_str(), l))
+			exit(1);
+		sink += l.cells.size();
+		return l.cells.size();
+	}
+};
+
+/* compileLevel: transition table and render tile list; items are cells */
+struct CompileBench : Bench {
+	Level parsed;
+	CompileBench(const Level &l) : parsed(l)
+	{
+		parsed.next.clear();
+		parsed.tiles.clear();
+		parsed.groupFirst.clear();
+	}
+	uint64_t run()
+	{
+		Level l = parsed;
+		compileLevel(l);
+		sink += l.tiles.size();
+		return l.cells.size();
+	}
+};
+
+/* The CPU side of draw(): pick the tiles to draw for a switch mask and lay
+ * out their translations, as drawTiles() does before each GL call. Items
+ * are tiles submitted. */
+struct RenderListBench : Bench {
+	const Level &level;
+	std::vector<float> out;
+	uint32_t mask;
+	RenderListBench(const Level &l) : level(l), out(l.tiles.size()*3), mask(l.startMask) {}
+	void add(size_t first, size_t last, size_t &n)
+	{
+		for (size_t i=first; i<last; i++)
+		{
+			const TileDraw &t = level.tiles[i];
+			out[n++] = t.x;
+			out[n++] = t.y;
+			out[n++] = (t.groups & mask) != 0;
+		}
+	}
+	uint64_t run()
+	{
+		const std::vector<int> &groupFirst = level.groupFirst;
+		size_t n = 0;
+		add(0, groupFirst[0], n);
+		for (int g=0; g<level.groups; g++)
+			if (mask >> g & 1)
+				add(groupFirst[g], groupFirst[g+1], n);
+		add(groupFirst[level.groups], level.tiles.size(), n);
+		mask = (mask + 1) & ((1u << level.groups) - 1);
+		sink += n;
+		return n/3;
+	}
+};
+
+/* Full BFS to the optimal solution; items are solves */
+struct SolveBench : Bench {
+	const Level &level;
+	SolveBench(const Level &l) : level(l) {}
+	uint64_t run()
+	{
+		sink += solveLevel(level);
+		return 1;
+	}
+};
+
+/* The same search also counting every optimal solution; items are solves */
+struct SolveStatsBench : Bench {
+	const Level &level;
+	SolveStats stats;
+	SolveStatsBench(const Level &l) : level(l) {}
+	uint64_t run()
+	{
+		solveStats(level, stats, false);
+		sink += stats.optimal;
+		return 1;
+	}
+};
+
+/* The training loop over an EnvBatch spread across all levels: step with
+ * random actions, then reset whatever finished. Items are env steps. */
+struct EnvBench : Bench {
+	EnvBatch env;
+	std::vector<uint8_t> actions;
+	unsigned offset;
+	EnvBench(const std::vector<Level> &levels, int n, int threads) : actions(n + 4096), offset(0)
+	{
+		if (!env.init(levels, n, threads))
+			exit(1);
+		env.setMaxSteps(200);
+		for (int i=0; i<n; i++)
+			env.setLevel(i, rng() % levels.size());
+		env.reset(NULL);
+		for (size_t i=0; i<actions.size(); i++)
+			actions[i] = rng() & 3;
+	}
+	uint64_t run()
+	{
+		env.step(&actions[offset]);
+		env.reset(env.done());
+		offset = (offset + 1021) & 4095;
+		sink += env.states()[0];
+		return env.size();
+	}
+};
+
+/* EnvBench plus bringing the observation planes up to date after each
+ * step. Items are env steps. */
+struct ObsBench : EnvBench {
+	ObsEncoder obs;
+	uint8_t *buf;
+	ObsBench(const std::vector<Level> &levels, int n) : EnvBench(levels, n, 1)
+	{
+		obs.init(env);
+		buf = (uint8_t*)aligned_alloc(OBS_ALIGN, (obs.bytes() + OBS_ALIGN-1) & ~(size_t)(OBS_ALIGN-1));
+		obs.encode(env, buf);
+	}
+	~ObsBench()
+	{
+		free(buf);
+	}
+	uint64_t run()
+	{
+		uint64_t n = EnvBench::run();
+		obs.encode(env, buf);
+		return n;
+	}
+};
+
+/* "levels/level01.txt" -> "level01", "levels.pack:3" -> "levels.pack:3" */
+static std::string baseName(const std::string &file)
+{
+	size_t slash = file.find_last_of('/');
+	std::string name = slash == std::string::npos ? file : file.substr(slash+1);
+	if (name.size() > 4 && name.compare(name.size()-4, 4, ".txt") == 0)
+		name.resize(name.size()-4);
+	return name;
+}
+
+int main(int argc, char **argv)
+{
+	const char *manifestPath = "manifest.txt";
+	for (int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-t") && i+1 < argc)
+			minTime = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-m") && i+1 < argc)
+			manifestPath = argv[++i];
+		else if (argv[i][0] == '-')
+		{
+			fprintf(stderr, "usage: bench [-t seconds] [-m manifest] [filter]\n");
+			return 1;
+		}
+		else
+			filter = argv[i];
+	}
+
+	std::vector<LevelEntry> manifest;
+	if (!loadManifest(manifestPath, manifest))
+		defaultManifest(manifest);
+	std::vector<Level> levels(manifest.size());
+	for (size_t i=0; i<manifest.size(); i++)
+		if (!loadLevel(manifest[i], levels[i]))
+			return 1;
+
+	char date[32];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+	printf("{\n  \"context\": {\"date\": \"%s\", \"levels\": %d, \"min_time\": %g},\n  \"benchmarks\": [",
+		date, (int)levels.size(), minTime);
+
+	for (size_t i=0; i<levels.size(); i++)
+	{
+		std::string name = baseName(manifest[i].file);
+		StepBench step(levels[i]);
+		measure("step/" + name, step);
+		RestBench rest(levels[i]);
+		measure("rest/" + name, rest);
+		// Packed levels have no text to parse
+		if (manifest[i].file.find(".pack:") == std::string::npos)
+		{
+			ParseBench parse(manifest[i].file);
+			measure("parse/" + name, parse);
+		}
+		CompileBench compile(levels[i]);
+		measure("compile/" + name, compile);
+		RenderListBench render(levels[i]);
+		measure("render_list/" + name, render);
+		SolveBench solve(levels[i]);
+		measure("solve/" + name, solve);
+		SolveStatsBench solveStats(levels[i]);
+		measure("solve_stats/" + name, solveStats);
+	}
+	EnvBench env(levels, 4096, 1);
+	measure("env/4096", env);
+	ObsBench obs(levels, 4096);
+	measure("env_obs/4096", obs);
+	EnvBench envThreads(levels, 1 << 22, 0);
+	measure("env/4M_threads", envThreads);
+	printf("\n  ]\n}\n");
+	return 0;
+}
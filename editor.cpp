@@ -0,0 +1,447 @@
+#include <queue>
+#include <algorithm>
+
+#include "editor.h"
+#include "rules.h"
+
+#define UNREACHED INT32_MAX
+
+static bool switchBefore(const SwitchLink &a, const SwitchLink &b)
+{
+	return a.cell < b.cell;
+}
+
+static bool bridgeBefore(const BridgeLink &a, const BridgeLink &b)
+{
+	return a.cell < b.cell;
+}
+
+/* compileLevel's tile order: type, then groups, then row-major */
+struct DrawOrder {
+	const Level &level;
+	int cellOf(const TileDraw &t) const
+	{
+		return (level.originY - (int)t.y)*level.width + level.originX - (int)t.x;
+	}
+	bool operator()(const TileDraw &a, const TileDraw &b) const
+	{
+		if (a.type != b.type)
+			return a.type < b.type;
+		if (a.groups != b.groups)
+			return a.groups < b.groups;
+		return cellOf(a) < cellOf(b);
+	}
+};
+
+void editLevel(Level &level)
+{
+	level.live.clear();
+	level.reached.clear();
+	level.reachableStates = level.deadStates = level.unreachableTiles = 0;
+	buildTileList(level);
+}
+
+void cycleTile(Level &level, int cell)
+{
+	int row = cell / level.width, col = cell % level.width;
+	int oldGroups = level.groups;
+	int type = (level.cells[cell] + 1) % TILE_KINDS;
+	// A split tile needs its @split line, so the editor can't make one
+	if (type == TILE_SPLIT)
+		type = (type + 1) % TILE_KINDS;
+	bool hadSplits = !level.splits.empty();
+	level.cells[cell] = type;
+
+	// The same bindings finishBindings would give, without a pass over the board
+	SwitchLink sw = { cell, 1 };
+	std::vector<SwitchLink>::iterator s = std::lower_bound(level.switches.begin(), level.switches.end(), sw, switchBefore);
+	if (s != level.switches.end() && s->cell == cell)
+		s = level.switches.erase(s);
+	if (tileKinds[type].trigger == TRIGGER_SWITCH || tileKinds[type].trigger == TRIGGER_HARD_SWITCH)
+		level.switches.insert(s, sw);
+	BridgeLink bridge = { cell, 0 };
+	std::vector<BridgeLink>::iterator b = std::lower_bound(level.bridges.begin(), level.bridges.end(), bridge, bridgeBefore);
+	if (b != level.bridges.end() && b->cell == cell)
+		b = level.bridges.erase(b);
+	if (tileKinds[type].support == SUPPORT_EXTENDED)
+		level.bridges.insert(b, bridge);
+	int groups = 0;
+	for (size_t i=0; i<level.switches.size(); i++)
+		groups = std::max(groups, 32 - __builtin_clz(level.switches[i].toggles));
+	for (size_t i=0; i<level.bridges.size(); i++)
+		groups = std::max(groups, level.bridges[i].group + 1);
+	level.groups = level.switches.empty() && level.bridges.empty() ? 0 : std::max(groups, 1);
+	if (!oldGroups && level.groups)
+		level.startMask = 1;
+	level.startMask &= level.groups ? (1u << level.groups) - 1 : 0;
+
+	DrawOrder order = { level };
+	for (size_t i=0; i<level.tiles.size(); i++)
+		if (order.cellOf(level.tiles[i]) == cell)
+		{
+			level.tiles.erase(level.tiles.begin() + i);
+			break;
+		}
+	if (type != TILE_EMPTY)
+	{
+		TileDraw t;
+		t.x = level.originX - col;
+		t.y = level.originY - row;
+		t.type = type;
+		t.groups = 0;
+		if (tileKinds[type].support == SUPPORT_EXTENDED)
+			t.groups = 1u << bridge.group;
+		else if (tileKinds[type].trigger == TRIGGER_SWITCH || tileKinds[type].trigger == TRIGGER_HARD_SWITCH)
+			t.groups = sw.toggles;
+		level.tiles.insert(std::lower_bound(level.tiles.begin(), level.tiles.end(), t, order), t);
+	}
+	level.groupFirst.assign(level.groups + 1, 0);
+	for (int g=0; g<=level.groups; g++)
+	{
+		TileDraw first = { 0, 0, TILE_BRIDGE, g < level.groups ? 1u << g : ~0u };
+		first.x = level.originX;
+		first.y = level.originY;
+		level.groupFirst[g] = std::lower_bound(level.tiles.begin(), level.tiles.end(), first, order) - level.tiles.begin();
+	}
+	// Split poses are numbered by floor cell, so those levels are redone whole;
+	// this also drops the link of a split tile cycled away
+	if (hadSplits)
+	{
+		finishBindings(level);
+		buildTransitions(level);
+	}
+}
+
+/* Where rolling dir from key ends: the new state, or -1 for a fall, -2 for a win */
+static int64_t landing(const Level &level, StateKey key, int dir)
+{
+	StateKey to;
+	int result = stepState(level, key, dir, &to);
+	return result == REST_OK ? (int64_t)to : result == REST_WIN ? -2 : -1;
+}
+
+struct RollIn {
+	int pose, dir;
+};
+
+/* Poses that roll onto pose, and the way they roll. Rolls undo each other,
+ * so these are the poses one roll away from it. */
+static int rollsInto(const Level &level, int pose, RollIn in[4])
+{
+	int n = 0;
+	for (int d=0; d<4; d++)
+	{
+		int from = level.next[(size_t)pose*4 + d];
+		if (from < 0)
+			continue;
+		for (int back=0; back<4; back++)
+			if (level.next[(size_t)from*4 + back] == pose)
+			{
+				in[n].pose = from;
+				in[n].dir = back;
+				n++;
+				break;
+			}
+	}
+	return n;
+}
+
+/* Groups the switches under pose flip when the block comes to rest there */
+static uint32_t landToggle(const Level &level, int pose)
+{
+	int rows[2], cols[2];
+	int n = level.poseCells(pose, rows, cols);
+	uint32_t toggle = 0;
+	for (int c=0; c<n; c++)
+	{
+		int trigger = tileKinds[level.at(rows[c], cols[c])].trigger;
+		if (trigger == TRIGGER_SWITCH || (trigger == TRIGGER_HARD_SWITCH && n == 1))
+			toggle |= level.switchToggles(rows[c], cols[c]);
+	}
+	return toggle;
+}
+
+/* States with a roll that lands on key; returns how many */
+static int predecessors(const Level &level, StateKey key, StateKey from[4])
+{
+	int pose = statePose(level, key);
+	uint32_t mask = stateMask(level, key) ^ landToggle(level, pose);
+	RollIn in[4];
+	int n = rollsInto(level, pose, in), found = 0;
+	for (int i=0; i<n; i++)
+	{
+		StateKey s = stateKey(level, in[i].pose, mask);
+		if (landing(level, s, in[i].dir) == key)
+			from[found++] = s;
+	}
+	return found;
+}
+
+/* Breadth-first distances to every state reachable from the start. Gives
+ * up, returning false, once latest moves past version. */
+static bool solveAll(const Level &level, std::vector<int32_t> &dist, const std::atomic<unsigned> *latest, unsigned version)
+{
+	dist.assign(stateCount(level), UNREACHED);
+	if (dist.empty() || level.next.empty())
+		return true;
+	std::vector<StateKey> queue;
+	StateKey start = startState(level);
+	dist[start] = 0;
+	queue.push_back(start);
+	for (size_t head=0; head<queue.size(); head++)
+	{
+		if ((head & 4095) == 0 && latest->load(std::memory_order_relaxed) != version)
+			return false;
+		StateKey key = queue[head];
+		for (int dir=0; dir<4; dir++)
+		{
+			StateKey to;
+			if (stepState(level, key, dir, &to) == REST_OK && dist[to] == UNREACHED)
+			{
+				dist[to] = dist[key] + 1;
+				queue.push_back(to);
+				// Handing over to the other cube of a split block is free
+				StateKey twin = level.splits.empty() ? to : swapState(level, to);
+				if (twin != to)
+				{
+					dist[twin] = dist[to];
+					queue.push_back(twin);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+/* Fewest moves to win given the distances: the best state one roll from
+ * standing on a goal */
+static int findOptimal(const Level &level, const std::vector<int32_t> &dist)
+{
+	int best = -1;
+	uint32_t masks = 1u << level.groups;
+	for (int cell=0; cell<(int)level.cells.size(); cell++)
+	{
+		if (tileKinds[level.cells[cell]].trigger != TRIGGER_GOAL)
+			continue;
+		RollIn in[4];
+		int n = rollsInto(level, cell*3, in);
+		for (int i=0; i<n; i++)
+			for (uint32_t mask=0; mask<masks; mask++)
+			{
+				StateKey s = stateKey(level, in[i].pose, mask);
+				if (dist[s] != UNREACHED && (best < 0 || dist[s] + 1 < best) && landing(level, s, in[i].dir) == -2)
+					best = dist[s] + 1;
+			}
+	}
+	return best;
+}
+
+EditSolver::EditSolver()
+	: current(false), optimal(-1), lastCost(0), version(0), jobVersion(0), latest(0), solvedVersion(0), quit(false)
+{
+	worker = std::thread(&EditSolver::run, this);
+}
+
+EditSolver::~EditSolver()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+		latest.store(~0u);
+	}
+	wake.notify_one();
+	worker.join();
+}
+
+void EditSolver::reset(const std::shared_ptr<const Level> &b)
+{
+	board = b;
+	version++;
+	solveInBackground();
+}
+
+void EditSolver::edited(const std::shared_ptr<const Level> &b, const std::vector<int> &cells)
+{
+	std::shared_ptr<const Level> before = board;
+	board = b;
+	version++;
+	if (!current || !before || before->width != b->width || before->height != b->height || before->groups != b->groups
+		|| !before->splits.empty() || !b->splits.empty() || !repair(*before, cells))
+	{
+		solveInBackground();
+		return;
+	}
+	optimal = findOptimal(*board, dist);
+}
+
+bool EditSolver::repair(const Level &before, const std::vector<int> &cells)
+{
+	typedef std::pair<int32_t, StateKey> Item;
+	std::priority_queue<Item, std::vector<Item>, std::greater<Item> > queue;
+	const Level &after = *board;
+	uint32_t masks = 1u << after.groups;
+	StateKey start = startState(after);
+	lastCost = 0;
+
+	// Reached states with a roll onto a changed cell that now ends elsewhere
+	struct Change {
+		StateKey from;
+		int64_t was, now;
+	};
+	std::vector<Change> changes;
+	for (size_t c=0; c<cells.size(); c++)
+	{
+		int cell = cells[c], row = cell / after.width, col = cell % after.width;
+		int poses[5] = { cell*3, cell*3 + 1, cell*3 + 2, -1, -1 };
+		if (col+1 < after.width)
+			poses[3] = (cell+1)*3 + 1;
+		if (row+1 < after.height)
+			poses[4] = (cell+after.width)*3 + 2;
+		for (int p=0; p<5; p++)
+		{
+			if (poses[p] < 0)
+				continue;
+			RollIn in[4];
+			int n = rollsInto(after, poses[p], in);
+			for (int i=0; i<n; i++)
+				for (uint32_t mask=0; mask<masks; mask++)
+				{
+					StateKey s = stateKey(after, in[i].pose, mask);
+					if (dist[s] == UNREACHED)
+						continue;
+					Change ch = { s, landing(before, s, in[i].dir), landing(after, s, in[i].dir) };
+					if (ch.was != ch.now)
+						changes.push_back(ch);
+				}
+		}
+	}
+
+	// States whose every shortest way in is gone, in distance order, so a
+	// state's predecessors are settled before it is looked at. Lost states
+	// are marked -1 until they are refilled.
+	for (size_t i=0; i<changes.size(); i++)
+		if (changes[i].was >= 0 && dist[changes[i].was] == dist[changes[i].from] + 1)
+			queue.push(Item(dist[changes[i].was], changes[i].was));
+	std::vector<StateKey> lost;
+	while (!queue.empty())
+	{
+		Item top = queue.top();
+		queue.pop();
+		StateKey v = top.second;
+		if (dist[v] != top.first || v == start)
+			continue;
+		if (++lastCost > EDIT_REPAIR_BUDGET)
+			return false;
+		StateKey from[4];
+		int n = predecessors(after, v, from);
+		bool held = false;
+		for (int i=0; i<n && !held; i++)
+			held = dist[from[i]] == top.first - 1;
+		if (held)
+			continue;
+		dist[v] = -1;
+		lost.push_back(v);
+		for (int dir=0; dir<4; dir++)
+		{
+			int64_t to = landing(after, v, dir);
+			if (to >= 0 && dist[to] == top.first + 1)
+				queue.push(Item(top.first + 1, to));
+		}
+	}
+
+	// Refill the lost states from what they still connect to, and lower
+	// states a new roll gets to sooner; then settle outwards
+	for (size_t i=0; i<lost.size(); i++)
+		dist[lost[i]] = UNREACHED;
+	for (size_t i=0; i<lost.size(); i++)
+	{
+		StateKey from[4];
+		int n = predecessors(after, lost[i], from);
+		for (int k=0; k<n; k++)
+			if (dist[from[k]] != UNREACHED && dist[from[k]] + 1 < dist[lost[i]])
+				dist[lost[i]] = dist[from[k]] + 1;
+		if (dist[lost[i]] != UNREACHED)
+			queue.push(Item(dist[lost[i]], lost[i]));
+	}
+	for (size_t i=0; i<changes.size(); i++)
+	{
+		const Change &ch = changes[i];
+		if (ch.now >= 0 && dist[ch.from] != UNREACHED && dist[ch.from] + 1 < dist[ch.now])
+		{
+			dist[ch.now] = dist[ch.from] + 1;
+			queue.push(Item(dist[ch.now], ch.now));
+		}
+	}
+	while (!queue.empty())
+	{
+		Item top = queue.top();
+		queue.pop();
+		if (dist[top.second] != top.first)
+			continue;
+		if (++lastCost > EDIT_REPAIR_BUDGET)
+			return false;
+		for (int dir=0; dir<4; dir++)
+		{
+			int64_t to = landing(after, top.second, dir);
+			if (to >= 0 && top.first + 1 < dist[to])
+			{
+				dist[to] = top.first + 1;
+				queue.push(Item(top.first + 1, to));
+			}
+		}
+	}
+	return true;
+}
+
+void EditSolver::solveInBackground()
+{
+	current = false;
+	lastCost = 0;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		job = board;
+		jobVersion = version;
+		latest.store(version);
+	}
+	wake.notify_one();
+}
+
+bool EditSolver::result(int *moves)
+{
+	if (!current)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (solvedVersion != version)
+			return false;
+		dist.swap(solved);
+		std::vector<int32_t>().swap(solved);
+		solvedVersion = 0;
+		current = true;
+		optimal = findOptimal(*board, dist);
+	}
+	*moves = optimal;
+	return true;
+}
+
+void EditSolver::run()
+{
+	std::unique_lock<std::mutex> hold(lock);
+	for (;;)
+	{
+		wake.wait(hold, [this] { return quit || job; });
+		if (quit)
+			return;
+		std::shared_ptr<const Level> level = job;
+		unsigned v = jobVersion;
+		job.reset();
+		hold.unlock();
+		std::vector<int32_t> d;
+		bool done = solveAll(*level, d, &latest, v);
+		hold.lock();
+		if (done && latest.load() == v)
+		{
+			solved.swap(d);
+			solvedVersion = v;
+		}
+	}
+}
@@ -0,0 +1,77 @@
+#ifndef EDITOR_H
+#define EDITOR_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+#include "level.h"
+
+/* In-game level editing: tiles are cycled one cell at a time and the
+ * optimal move count is kept up to date as the board changes. */
+
+/* States a repair may visit before the edit is solved from scratch instead */
+#define EDIT_REPAIR_BUDGET (1 << 16)
+
+/* Ready a compiled level for editing: drops the reachability search, which
+ * the first edit would make stale, and puts every tile in the tile list,
+ * reachable or not, so the author sees what they made */
+void editLevel(Level &level);
+/* Turn the tile at cell of a level readied by editLevel() into the next
+ * kind in TileType order, wrapping back to empty and skipping split tiles,
+ * which need an @split line. New switches and bridges go in group 0,
+ * extended at the start if the level had no groups before. Bindings and
+ * the tile list are patched in place rather than rebuilt, except on levels
+ * with split tiles. */
+void cycleTile(Level &level, int cell);
+
+/* The fewest moves from the start to every reachable state, kept across
+ * edits. After an edit only the rolls that land on the changed cells are
+ * looked at again: states that lost their shortest way in are cleared and
+ * refilled from their neighbours, and states a new roll gets to sooner are
+ * lowered, both in distance order. An edit that changes the number of
+ * bridge groups or is on a level with split tiles, or whose repair would
+ * visit more than EDIT_REPAIR_BUDGET states, is solved from scratch on a
+ * background thread instead, so a click never stalls the caller. Used from
+ * one thread. */
+class EditSolver {
+public:
+	EditSolver();
+	~EditSolver();
+	/* Solve board from scratch in the background */
+	void reset(const std::shared_ptr<const Level> &board);
+	/* board is the last one given with cells changed; same size */
+	void edited(const std::shared_ptr<const Level> &board, const std::vector<int> &cells);
+	/* True with the optimal move count (-1 if it can't be won) when it is
+	 * known for the latest board, false while a background solve runs */
+	bool result(int *optimal);
+	/* States the last repair visited, 0 if it went to the background */
+	int repairCost() const { return lastCost; }
+private:
+	bool repair(const Level &before, const std::vector<int> &cells);
+	void solveInBackground();
+	void run();
+
+	std::shared_ptr<const Level> board;
+	std::vector<int32_t> dist;		// per state key, INT32_MAX if unreached
+	bool current;					// dist and optimal are for board
+	int optimal;
+	int lastCost;
+	unsigned version;				// bumped for every board
+
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::shared_ptr<const Level> job;	// next board for the worker, NULL if none
+	unsigned jobVersion;
+	std::atomic<unsigned> latest;		// version the worker should still be solving
+	std::vector<int32_t> solved;		// finished background distances
+	unsigned solvedVersion;
+	bool quit;
+};
+
+#endif
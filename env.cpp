@@ -0,0 +1,229 @@
+#include <cstdio>
+#include <cstring>
+
+#include "env.h"
+
+/* Below this many environments per thread the pool costs more than it saves */
+#define ENV_CHUNK 16384
+
+enum EnvJob {
+	ENV_JOB_STEP,	// input is the actions
+	ENV_JOB_RESET	// input is the mask
+};
+
+EnvBatch::EnvBatch() : count(0), maxSteps(0), chunks(1), jobKind(ENV_JOB_STEP), jobInput(NULL), generation(0), pending(0), quit(false)
+{
+	rewards.step = -0.01f;
+	rewards.fall = -1;
+	rewards.win = 1;
+}
+
+EnvBatch::~EnvBatch()
+{
+	stopWorkers();
+}
+
+bool EnvBatch::init(const std::vector<Level> &levels, int n, int threads)
+{
+	stopWorkers();
+	if (levels.empty() || levels.size() > 65535)
+	{
+		fprintf(stderr, "env: need 1 to 65535 levels\n");
+		return false;
+	}
+	size_t total = 0;
+	for (size_t l=0; l<levels.size(); l++)
+	{
+		if ((size_t)levels[l].poseCount() << levels[l].groups > ENV_MAX_STATES)
+		{
+			fprintf(stderr, "env: level %d has too many states\n", (int)l+1);
+			return false;
+		}
+		// The four actions are rolls; a split block would need a Tab too
+		if (!levels[l].splits.empty())
+		{
+			fprintf(stderr, "env: level %d has split tiles\n", (int)l+1);
+			return false;
+		}
+		total += stateCount(levels[l]);
+	}
+	if (total > 0x7fffffff / 4)
+	{
+		fprintf(stderr, "env: levels have too many states together\n");
+		return false;
+	}
+
+	// Unroll every level's StateKey graph into the shared table
+	levelList.clear();
+	base.clear();
+	start.clear();
+	next.resize(total*4);
+	int32_t first = 0;
+	for (size_t l=0; l<levels.size(); l++)
+	{
+		const Level &level = levels[l];
+		levelList.push_back(&level);
+		base.push_back(first);
+		start.push_back(first + startState(level));
+		int states = stateCount(level);
+		for (int key=0; key<states; key++)
+			for (int dir=0; dir<4; dir++)
+			{
+				StateKey to;
+				int result = stepState(level, key, dir, &to);
+				next[(size_t)(first + key)*4 + dir] = result == REST_OK ? first + (int32_t)to
+					: result == REST_WIN ? ENV_WIN : ENV_FALL;
+			}
+		first += states;
+	}
+
+	count = n;
+	state.assign(n, start[0]);
+	rewardOut.assign(n, 0);
+	doneOut.assign(n, ENV_RUNNING);
+	stepCount.assign(n, 0);
+	levelOf.assign(n, 0);
+	nextLevel.assign(n, 0);
+
+	if (threads <= 0)
+		threads = std::thread::hardware_concurrency();
+	if (threads > n / ENV_CHUNK)
+		threads = n / ENV_CHUNK;
+	quit = false;
+	generation = 0;
+	chunks = threads > 1 ? threads : 1;
+	for (int t=1; t<chunks; t++)
+		workers.push_back(std::thread(&EnvBatch::worker, this, t));
+	return true;
+}
+
+void EnvBatch::setLevel(int env, int level)
+{
+	if ((unsigned)level < levelList.size())
+		nextLevel[env] = level;
+}
+
+/* Same idea as stepKernel: selects rather than branches, so resetting the
+ * finished envs after every step stays cheap */
+static void resetKernel(const int32_t *__restrict start, const uint16_t *__restrict nextLevel,
+	const uint8_t *__restrict mask, uint16_t *__restrict levelOf, int32_t *__restrict state,
+	float *__restrict reward, uint8_t *__restrict done, int32_t *__restrict steps, int count)
+{
+	for (int i=0; i<count; i++)
+	{
+		bool hit = mask[i] != 0;
+		levelOf[i] = hit ? nextLevel[i] : levelOf[i];
+		state[i] = hit ? start[nextLevel[i]] : state[i];
+		reward[i] = hit ? 0.0f : reward[i];
+		done[i] = hit ? (uint8_t)ENV_RUNNING : done[i];
+		steps[i] = hit ? 0 : steps[i];
+	}
+}
+
+void EnvBatch::reset(const uint8_t *mask)
+{
+	if (count == 0)
+		return;
+	std::vector<uint8_t> all;
+	if (!mask)
+	{
+		all.assign(count, 1);
+		mask = &all[0];
+	}
+	run(ENV_JOB_RESET, mask);
+}
+
+/* Branch-free and alias-free so the compiler can vectorise it: every env
+ * does the same gather and selects, finished ones just keep their state. */
+static void stepKernel(const int32_t *__restrict table, const uint8_t *__restrict actions,
+	int32_t *__restrict state, float *__restrict reward, uint8_t *__restrict done,
+	int32_t *__restrict steps, int count, int32_t limit, EnvRewards rewards)
+{
+	for (int i=0; i<count; i++)
+	{
+		int32_t cur = state[i];
+		int32_t to = table[cur*4 + (actions[i] & 3)];
+		int32_t live = done[i] == ENV_RUNNING;
+		int32_t won = to == ENV_WIN, fell = to == ENV_FALL, moved = !won & !fell;
+		int32_t n = steps[i] + live;
+		int32_t outcome = won*ENV_WON + fell*ENV_FELL + (moved & (n >= limit))*ENV_TIMEOUT;
+		float gain = won*rewards.win + fell*rewards.fall + moved*rewards.step;
+		int32_t take = -(live & moved);
+		state[i] = cur ^ ((cur ^ to) & take);
+		reward[i] = gain * (float)live;
+		steps[i] = n;
+		done[i] |= outcome & -live;	// done[i] is ENV_RUNNING (0) whenever live
+	}
+}
+
+void EnvBatch::runRange(int job, const uint8_t *input, int first, int last)
+{
+	if (job == ENV_JOB_STEP)
+		stepKernel(&next[0], input + first, &state[first], &rewardOut[first], &doneOut[first],
+			&stepCount[first], last - first, maxSteps > 0 ? maxSteps : 0x7fffffff, rewards);
+	else
+		resetKernel(&start[0], &nextLevel[first], input + first, &levelOf[first], &state[first],
+			&rewardOut[first], &doneOut[first], &stepCount[first], last - first);
+}
+
+void EnvBatch::step(const uint8_t *actions)
+{
+	run(ENV_JOB_STEP, actions);
+}
+
+void EnvBatch::run(int job, const uint8_t *input)
+{
+	if (workers.empty())
+	{
+		runRange(job, input, 0, count);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobKind = job;
+		jobInput = input;
+		pending = chunks - 1;
+		generation++;
+	}
+	wake.notify_all();
+	runRange(job, input, 0, (long long)count / chunks);
+	std::unique_lock<std::mutex> guard(lock);
+	while (pending)
+		finished.wait(guard);
+}
+
+void EnvBatch::worker(int index)
+{
+	unsigned seen = 0;
+	for (;;)
+	{
+		int job;
+		const uint8_t *input;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (!quit && generation == seen)
+				wake.wait(guard);
+			if (quit)
+				return;
+			seen = generation;
+			job = jobKind;
+			input = jobInput;
+		}
+		runRange(job, input, (long long)count*index / chunks, (long long)count*(index+1) / chunks);
+		std::lock_guard<std::mutex> guard(lock);
+		if (--pending == 0)
+			finished.notify_one();
+	}
+}
+
+void EnvBatch::stopWorkers()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t t=0; t<workers.size(); t++)
+		workers[t].join();
+	workers.clear();
+}
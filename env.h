@@ -0,0 +1,115 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "level.h"
+#include "rules.h"
+
+/* Batched environments for training agents: N independent games stepped
+ * together, without GL or globals.
+ *
+ * Every level's StateKey graph is unrolled once into one shared table,
+ * next[(base + key)*4 + dir], so an environment is just a global state
+ * index and a step is one load plus a few selects. Per-environment data is
+ * kept struct-of-arrays so the step loop vectorises. */
+
+/* Table entries for a roll that doesn't end on the board */
+#define ENV_FALL -1
+#define ENV_WIN -2
+
+/* Largest StateKey space of one level the batch will unroll */
+#define ENV_MAX_STATES (1 << 24)
+
+enum EnvDone {
+	ENV_RUNNING = 0,
+	ENV_WON,
+	ENV_FELL,
+	ENV_TIMEOUT
+};
+
+struct EnvRewards {
+	float step, fall, win;
+};
+
+class EnvBatch {
+public:
+	EnvBatch();
+	~EnvBatch();
+	/* count environments over compiled levels, all on level 0 at its start.
+	 * The levels must outlive the batch. threads 0 picks the hardware thread
+	 * count. Fails if a level's state space is over ENV_MAX_STATES, or it
+	 * has split tiles: actions are the four rolls, with no Tab. */
+	bool init(const std::vector<Level> &levels, int count, int threads = 0);
+	int size() const { return count; }
+
+	void setRewards(const EnvRewards &r) { rewards = r; }
+	/* Steps before an environment is done with ENV_TIMEOUT, 0 for no limit */
+	void setMaxSteps(int steps) { maxSteps = steps; }
+	/* Level played by env from its next reset; until then levels() and
+	 * the rest still give the one it is on */
+	void setLevel(int env, int level);
+
+	/* Put the environments with a non-zero mask byte back on their level's
+	 * start; NULL resets all of them */
+	void reset(const uint8_t *mask);
+	/* One DIR_* per environment. Finished environments stay put with zero
+	 * reward until they are reset. */
+	void step(const uint8_t *actions);
+
+	/* Results, size() entries each, valid until the next step or reset */
+	const int32_t *states() const { return &state[0]; }	// global state index
+	const float *reward() const { return &rewardOut[0]; }
+	const uint8_t *done() const { return &doneOut[0]; }
+	const int32_t *steps() const { return &stepCount[0]; }
+	const uint16_t *levels() const { return &levelOf[0]; }
+
+	/* Global state index back to the level's own StateKey */
+	StateKey localState(int env) const { return state[env] - base[levelOf[env]]; }
+	const Level &level(int env) const { return *levelList[levelOf[env]]; }
+	int levelCount() const { return levelList.size(); }
+	const Level &levelAt(int index) const { return *levelList[index]; }
+	/* First global state index of level index */
+	int32_t levelBase(int index) const { return base[index]; }
+
+private:
+	EnvBatch(const EnvBatch&);
+	EnvBatch& operator=(const EnvBatch&);
+
+	void runRange(int job, const uint8_t *input, int first, int last);
+	void run(int job, const uint8_t *input);
+	void worker(int index);
+	void stopWorkers();
+
+	std::vector<const Level*> levelList;
+	std::vector<int32_t> next;		// all levels' transitions, see above
+	std::vector<int32_t> base;		// first global state of each level
+	std::vector<int32_t> start;		// global start state of each level
+
+	int count;
+	EnvRewards rewards;
+	int maxSteps;
+	std::vector<int32_t> state;
+	std::vector<float> rewardOut;
+	std::vector<uint8_t> doneOut;
+	std::vector<int32_t> stepCount;
+	std::vector<uint16_t> levelOf;
+	std::vector<uint16_t> nextLevel;	// from setLevel, taken up by reset
+
+	/* Worker pool for big batches; the calling thread takes chunk 0 */
+	int chunks;
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake, finished;
+	int jobKind;
+	const uint8_t *jobInput;
+	unsigned generation;
+	int pending;
+	bool quit;
+};
+
+#endif
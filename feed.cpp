@@ -0,0 +1,216 @@
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "feed.h"
+
+static_assert(sizeof(FeedSegment) == 64, "FeedSegment layout");
+// Atomics that take a lock would keep it in this process, not the segment
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+	"FeedSegment needs lock-free atomics");
+
+/* Tries a reader makes before giving up on a consistent copy */
+#define FEED_READ_TRIES 1024
+
+SpectateFeed::SpectateFeed() : fd(-1), seg(NULL)
+{
+	name[0] = 0;
+}
+
+SpectateFeed::~SpectateFeed()
+{
+	close();
+}
+
+void SpectateFeed::close()
+{
+	if (seg)
+	{
+		// Under the seqlock like any other update, so readers see it in one piece
+		uint32_t seq = seg->seq.load(std::memory_order_relaxed);
+		seg->seq.store(seq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		seg->flags.fetch_or(FEED_CLOSED, std::memory_order_relaxed);
+		seg->seq.store(seq + 2, std::memory_order_release);
+		munmap(seg, sizeof(FeedSegment));
+		// Still holding the lock, so the name is ours to remove
+		shm_unlink(name);
+		seg = NULL;
+	}
+	if (fd >= 0)
+		::close(fd);	// drops the lock too
+	fd = -1;
+}
+
+/* Whether fd is still the segment path names, and not one a game that
+ * just exited unlinked after we opened it */
+static bool stillNamed(const char *path, int fd)
+{
+	int again = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+	if (again < 0)
+		return false;
+	struct stat a, b;
+	bool same = fstat(fd, &a) == 0 && fstat(again, &b) == 0 && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+	::close(again);
+	return same;
+}
+
+bool SpectateFeed::open(const char *path)
+{
+	close();
+	if (strlen(path) >= sizeof(name))
+	{
+		fprintf(stderr, "Spectator feed name too long: %s\n", path);
+		return false;
+	}
+	for (;;)
+	{
+		fd = shm_open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+		if (fd < 0)
+		{
+			perror(path);
+			return false;
+		}
+		if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+		{
+			fprintf(stderr, "%s: spectator feed in use by another game\n", path);
+			close();
+			return false;
+		}
+		if (stillNamed(path, fd))
+			break;
+		close();
+	}
+	// Starting from zero clears what an old game that crashed left behind
+	if (ftruncate(fd, 0) < 0 || ftruncate(fd, sizeof(FeedSegment)) < 0)
+	{
+		perror(path);
+		close();
+		return false;
+	}
+	void *map = mmap(NULL, sizeof(FeedSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: mmap failed\n", path);
+		close();
+		return false;
+	}
+	strcpy(name, path);
+	seg = (FeedSegment*)map;
+	seg->magic = FEED_MAGIC;
+	seg->size = sizeof(FeedSegment);
+	// Readers check the version last, once the rest is in place
+	std::atomic_thread_fence(std::memory_order_release);
+	seg->version = FEED_VERSION;
+	return true;
+}
+
+void SpectateFeed::publish(const SpectateState &s)
+{
+	if (!seg)
+		return;
+	// Only this thread writes seq, so a plain load is the latest value
+	uint32_t seq = seg->seq.load(std::memory_order_relaxed);
+	seg->seq.store(seq + 1, std::memory_order_relaxed);
+	// Keeps the field stores below from being seen before seq goes odd
+	std::atomic_thread_fence(std::memory_order_release);
+	seg->level.store(s.level, std::memory_order_relaxed);
+	seg->row.store(s.row, std::memory_order_relaxed);
+	seg->col.store(s.col, std::memory_order_relaxed);
+	seg->orientation.store(s.orientation, std::memory_order_relaxed);
+	seg->mask.store(s.mask, std::memory_order_relaxed);
+	seg->moves.store(s.moves, std::memory_order_relaxed);
+	seg->boardVersion.store(s.boardVersion, std::memory_order_relaxed);
+	seg->flags.store(s.flags & ~FEED_CLOSED, std::memory_order_relaxed);
+	seg->row2.store(s.row2, std::memory_order_relaxed);
+	seg->col2.store(s.col2, std::memory_order_relaxed);
+	seg->time.store(s.time, std::memory_order_relaxed);
+	seg->seq.store(seq + 2, std::memory_order_release);
+}
+
+SpectateView::SpectateView() : seg(NULL)
+{
+}
+
+SpectateView::~SpectateView()
+{
+	close();
+}
+
+void SpectateView::close()
+{
+	if (seg)
+		munmap((void*)seg, sizeof(FeedSegment));
+	seg = NULL;
+}
+
+bool SpectateView::open(const char *path)
+{
+	close();
+	int fd = shm_open(path, O_RDONLY | O_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		fprintf(stderr, "No spectator feed %s; is the game running with --spectate?\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(FeedSegment))
+	{
+		fprintf(stderr, "%s: not a spectator feed\n", path);
+		::close(fd);
+		return false;
+	}
+	void *map = mmap(NULL, sizeof(FeedSegment), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+		fprintf(stderr, "%s: mmap failed\n", path);
+		return false;
+	}
+	seg = (const FeedSegment*)map;
+	uint32_t version = seg->version;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (seg->magic != FEED_MAGIC || version != FEED_VERSION || seg->size != sizeof(FeedSegment))
+	{
+		fprintf(stderr, "%s: not a spectator feed\n", path);
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool SpectateView::read(SpectateState &s) const
+{
+	if (!seg)
+		return false;
+	for (int tries=0; tries<FEED_READ_TRIES; tries++)
+	{
+		uint32_t seq = seg->seq.load(std::memory_order_acquire);
+		if (seq & 1)
+			continue;	// mid-update
+		s.level = seg->level.load(std::memory_order_relaxed);
+		s.row = seg->row.load(std::memory_order_relaxed);
+		s.col = seg->col.load(std::memory_order_relaxed);
+		s.orientation = seg->orientation.load(std::memory_order_relaxed);
+		s.mask = seg->mask.load(std::memory_order_relaxed);
+		s.moves = seg->moves.load(std::memory_order_relaxed);
+		s.boardVersion = seg->boardVersion.load(std::memory_order_relaxed);
+		s.flags = seg->flags.load(std::memory_order_relaxed);
+		s.row2 = seg->row2.load(std::memory_order_relaxed);
+		s.col2 = seg->col2.load(std::memory_order_relaxed);
+		s.time = seg->time.load(std::memory_order_relaxed);
+		// Keeps the field loads above from moving past the second look at seq
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (seg->seq.load(std::memory_order_relaxed) == seq)
+		{
+			s.seq = seq;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,94 @@
+#ifndef FEED_H
+#define FEED_H
+
+#include <stdint.h>
+#include <atomic>
+
+/* Live game state for spectator and overlay processes, in a POSIX shared
+ * memory segment the game rewrites every simulation tick. The segment is
+ * guarded by a seqlock: the game bumps seq to odd, writes the fields and
+ * bumps it to even again, never waiting on anyone. Readers map the segment
+ * once and then only load from it, retrying if seq was odd or changed
+ * under them, so any number of them cost the game nothing. */
+
+#define FEED_MAGIC 0x44465842		// "BXFD"
+#define FEED_VERSION 2
+#define FEED_DEFAULT_NAME "/bloxorz"
+
+/* SpectateState::flags */
+#define FEED_FALLING 1		// the attempt is over, the block is dropping
+#define FEED_WON 2			// ... into the goal
+#define FEED_OVER 4			// no more levels
+#define FEED_CLOSED 8		// the game has exited
+
+/* One reading of the feed */
+struct SpectateState {
+	uint32_t seq;			// even; changes with every tick published
+	uint32_t level;			// manifest position, from 1
+	int32_t row, col;		// block pose on the grid; the cube that moves next if split
+	uint32_t orientation;	// 0 standing, 1 lying along x, 2 along y, 3 split
+	int32_t row2, col2;		// the other cube when split
+	uint32_t mask;			// extended bridge groups
+	uint32_t moves;
+	uint32_t boardVersion;	// changes whenever the board is replaced
+	uint32_t flags;
+	uint64_t time;			// since the game started, ns
+};
+
+/* The segment. Every field is an atomic so concurrent access is defined;
+ * the seqlock is what makes a reading consistent. */
+struct alignas(64) FeedSegment {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	std::atomic<uint32_t> seq;
+	std::atomic<uint32_t> level;
+	std::atomic<int32_t> row, col;
+	std::atomic<uint32_t> orientation;
+	std::atomic<uint32_t> mask;
+	std::atomic<uint32_t> moves;
+	std::atomic<uint32_t> boardVersion;
+	std::atomic<uint32_t> flags;
+	std::atomic<int32_t> row2, col2;
+	std::atomic<uint64_t> time;
+};
+
+/* The game's side. Open takes an exclusive flock on the segment, so a
+ * second game can't take over a name that is in use. The segment is
+ * removed again on close, after marking it FEED_CLOSED for readers that
+ * still have it mapped. */
+class SpectateFeed {
+public:
+	SpectateFeed();
+	~SpectateFeed();
+	bool open(const char *name);
+	void close();
+	/* seq in state is ignored */
+	void publish(const SpectateState &state);
+private:
+	SpectateFeed(const SpectateFeed&);
+	SpectateFeed& operator=(const SpectateFeed&);
+
+	char name[256];
+	int fd;				// held open for the lock
+	FeedSegment *seg;
+};
+
+/* A reader's side */
+class SpectateView {
+public:
+	SpectateView();
+	~SpectateView();
+	bool open(const char *name);
+	void close();
+	/* A consistent copy of the current state; false only if the writer
+	 * kept being mid-update for a long spin, which it never is for long */
+	bool read(SpectateState &state) const;
+private:
+	SpectateView(const SpectateView&);
+	SpectateView& operator=(const SpectateView&);
+
+	const FeedSegment *seg;
+};
+
+#endif
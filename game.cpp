@@ -0,0 +1,191 @@
+#include <algorithm>
+
+#include "game.h"
+
+/* What checkBlock() used to do: see what the block rests on */
+static void settle(GameState &game)
+{
+	const Level &board = *game.board;
+	uint32_t toggle;
+	int result;
+	if (game.orientation == ORIENT_SPLIT)
+		result = restCube(board, game.row, game.col, game.mask, &toggle);
+	else
+		result = restBlock(board, game.row, game.col, game.orientation, game.mask, &toggle);
+	if (result == REST_SPLIT)
+	{
+		const SplitLink *s = board.splitAt(game.row*board.width + game.col);
+		uint32_t toggles[2];
+		int a = restCube(board, s->cubes[0] / board.width, s->cubes[0] % board.width, game.mask, &toggles[0]);
+		int b = restCube(board, s->cubes[1] / board.width, s->cubes[1] % board.width, game.mask, &toggles[1]);
+		game.row = s->cubes[0] / board.width;
+		game.col = s->cubes[0] % board.width;
+		game.row2 = s->cubes[1] / board.width;
+		game.col2 = s->cubes[1] % board.width;
+		game.orientation = ORIENT_SPLIT;
+		toggle = toggles[0] | toggles[1];
+		result = a == REST_OK && b == REST_OK ? REST_OK : REST_FALL;
+	}
+	game.mask ^= toggle;
+	if (result != REST_OK)
+		game.falling = true;
+	if (result == REST_WIN)
+		game.won = true;
+	// Cubes that end up side by side are one block again
+	int joined = game.orientation == ORIENT_SPLIT && !game.falling ? joinCubes(board, game.row, game.col, game.row2, game.col2) : -1;
+	if (joined >= 0)
+	{
+		game.row = joined / 3 / board.width;
+		game.col = joined / 3 % board.width;
+		game.orientation = joined % 3;
+	}
+}
+
+static GameStep position(const GameState &game, int dir)
+{
+	GameStep step = { (int16_t)game.row, (int16_t)game.col, (uint16_t)game.mask, (uint8_t)game.orientation, (uint8_t)dir,
+		(int16_t)game.row2, (int16_t)game.col2 };
+	return step;
+}
+
+void GameHistory::setCapacity(int capacity)
+{
+	steps.assign(capacity, GameStep());
+	first = at = last = 0;
+}
+
+void GameHistory::reset(const GameStep &start)
+{
+	first = at = last = 0;
+	if (!steps.empty())
+		steps[0] = start;
+}
+
+void GameHistory::push(const GameStep &step)
+{
+	if (steps.empty())
+		return;
+	at++;
+	GameStep &slot = steps[at % steps.size()];
+	bool redone = at <= last && slot.dir == step.dir;
+	slot = step;
+	if (!redone)
+		last = at;
+	if (at - first >= steps.size())
+		first = at - steps.size() + 1;
+}
+
+bool GameHistory::undo(GameStep *step)
+{
+	if (at == first)
+		return false;
+	at--;
+	*step = steps[at % steps.size()];
+	return true;
+}
+
+bool GameHistory::peekRedo(GameStep *step) const
+{
+	if (at == last)
+		return false;
+	*step = steps[(at+1) % steps.size()];
+	return true;
+}
+
+void gameStart(GameState &game, const std::shared_ptr<const Level> &board, int level)
+{
+	game.board = board;
+	game.level = level;
+	game.row = board->startRow;
+	game.col = board->startCol;
+	game.row2 = game.col2 = 0;
+	game.orientation = 0;
+	game.mask = board->startMask;
+	game.falling = false;
+	game.won = false;
+	game.blockz = 0;
+	game.moveLog.clear();
+	game.rolls = 0;
+	settle(game);
+	game.history.reset(position(game, 0));
+}
+
+bool gameRoll(GameState &game, int dir)
+{
+	if (game.falling)
+		return false;
+	const Roll &r = rollTable[game.orientation][dir];
+	game.col -= r.dx;
+	game.row -= r.dy;
+	game.orientation = r.orientation;
+	game.moveLog.push_back(dir);
+	game.rolls++;
+	settle(game);
+	game.history.push(position(game, dir));
+	return true;
+}
+
+bool gameSwap(GameState &game)
+{
+	if (game.falling || game.orientation != ORIENT_SPLIT)
+		return false;
+	std::swap(game.row, game.row2);
+	std::swap(game.col, game.col2);
+	game.moveLog.push_back(DIR_SWAP);
+	game.history.push(position(game, DIR_SWAP));
+	return true;
+}
+
+bool gameUndo(GameState &game)
+{
+	GameStep step;
+	if (game.won || !game.history.undo(&step))
+		return false;
+	// Put back exactly what was there; settling again would re-press switches
+	game.row = step.row;
+	game.col = step.col;
+	game.row2 = step.row2;
+	game.col2 = step.col2;
+	game.orientation = step.orientation;
+	game.mask = step.mask;
+	game.falling = false;
+	game.blockz = 0;
+	// The history holds one position per entry in the log
+	if (game.moveLog.back() != DIR_SWAP)
+		game.rolls--;
+	game.moveLog.pop_back();
+	return true;
+}
+
+bool gameRedo(GameState &game)
+{
+	GameStep step;
+	if (game.falling || !game.history.peekRedo(&step))
+		return false;
+	return step.dir == DIR_SWAP ? gameSwap(game) : gameRoll(game, step.dir);
+}
+
+void gameSetBoard(GameState &game, const std::shared_ptr<const Level> &board)
+{
+	game.board = board;
+	if (game.falling)
+		return;
+	// The same support checks settle() makes, without acting on the rest
+	uint32_t toggle;
+	bool held;
+	if (game.orientation == ORIENT_SPLIT)
+		held = restCube(*board, game.row, game.col, game.mask, &toggle) == REST_OK
+			&& restCube(*board, game.row2, game.col2, game.mask, &toggle) == REST_OK;
+	else
+		held = restBlock(*board, game.row, game.col, game.orientation, game.mask, &toggle) != REST_FALL;
+	if (!held)
+		game.falling = true;
+}
+
+bool gameFall(GameState &game, float dt)
+{
+	if (!game.falling)
+		return false;
+	game.blockz -= GAME_FALL_SPEED * dt;
+	return game.blockz < -GAME_FALL_DEPTH;
+}
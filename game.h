@@ -0,0 +1,97 @@
+#ifndef GAME_H
+#define GAME_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "level.h"
+#include "rules.h"
+
+/* One player's game without any globals, so the GL client, the session
+ * manager and tools can all run as many as they like. The board is shared
+ * and read-only; everything else belongs to the state. */
+
+/* Falling speed in units per second, and how far the block drops before
+ * the fall (or the drop into the goal) is over */
+#define GAME_FALL_SPEED 1.38f
+#define GAME_FALL_DEPTH 2.0f
+
+/* One position in the undo history, 12 bytes. Its move count is its
+ * index in the history less the swaps before it, so it isn't stored. */
+struct GameStep {
+	int16_t row, col;		// may be off the board after a fatal roll
+	uint16_t mask;
+	uint8_t orientation;
+	uint8_t dir;			// the roll that led here, or DIR_SWAP
+	int16_t row2, col2;		// the other cube of a split block
+};
+static_assert(sizeof(GameStep) == 12, "the undo ring's size is quoted in the Readme");
+
+/* Undo / redo ring holding the positions after moves first..last of an
+ * attempt, with the game at move count at. A full ring drops its oldest
+ * position, so undo reaches back capacity-1 moves. Everything is constant
+ * time. Capacity 0, the default, keeps no history. */
+class GameHistory {
+public:
+	GameHistory() : first(0), at(0), last(0) {}
+	/* Also forgets the history */
+	void setCapacity(int capacity);
+	int capacity() const { return steps.size(); }
+	void reset(const GameStep &start);
+	/* The position after a move from at. Redo stays possible if it was the
+	 * roll redo would have played. */
+	void push(const GameStep &step);
+	/* Step back to the previous position; false at the oldest one kept */
+	bool undo(GameStep *step);
+	/* The next position, without moving to it; false if there is none */
+	bool peekRedo(GameStep *step) const;
+private:
+	std::vector<GameStep> steps;
+	uint32_t first, at, last;
+};
+
+struct GameState {
+	std::shared_ptr<const Level> board;
+	int level;					// manifest position, from 1
+	int row, col, orientation;	// block pose on the grid; the cube that moves next if split
+	int row2, col2;				// the other cube, with orientation ORIENT_SPLIT
+	uint32_t mask;				// extended bridge groups
+	bool falling;				// into the goal if won, off the board otherwise
+	bool won;
+	float blockz;
+	std::vector<uint8_t> moveLog;	// DIR_* of every roll and DIR_SWAP
+	int rolls;						// moveLog less the swaps, which aren't moves
+	GameHistory history;
+
+	GameState() : level(0), row(0), col(0), orientation(0), row2(0), col2(0), mask(0), falling(false), won(false), blockz(0), rolls(0) {}
+	int moves() const { return rolls; }
+	/* World position of the block, as the renderer places it */
+	float worldX() const { return board->originX - col; }
+	float worldY() const { return board->originY - row; }
+	float worldX2() const { return board->originX - col2; }
+	float worldY2() const { return board->originY - row2; }
+};
+
+/* Put the block on board's start tile with no moves made */
+void gameStart(GameState &game, const std::shared_ptr<const Level> &board, int level);
+/* Roll the block. Ignored, returning false, while it is falling. A roll
+ * that ends the attempt sets falling (and won if it reached the goal). */
+bool gameRoll(GameState &game, int dir);
+/* Hand over to the other cube of a split block, which isn't a move. False
+ * if the block isn't split or is falling. */
+bool gameSwap(GameState &game);
+/* Take back the last roll or swap, even a roll the block is still falling
+ * from, but not a win. False if there is nothing left to undo. */
+bool gameUndo(GameState &game);
+/* Play the last undone roll or swap again; false if there is none */
+bool gameRedo(GameState &game);
+/* Swap board in under the block, e.g. an edited copy of the one played,
+ * and drop the block if what it stands on is gone. Switches under it
+ * aren't pressed again; a new goal or split tile only counts from the
+ * next roll. */
+void gameSetBoard(GameState &game, const std::shared_ptr<const Level> &board);
+/* Advance the fall by dt seconds; true once it has finished */
+bool gameFall(GameState &game, float dt);
+
+#endif
@@ -0,0 +1,159 @@
+#include "graph.h"
+
+void buildGraph(const Level &level, StateGraph &graph)
+{
+	graph.keys.clear();
+	graph.next.clear();
+	graph.depth.clear();
+	graph.twin.clear();
+	graph.optimal = -1;
+	graph.indexOf.assign(stateCount(level), -1);
+	if (graph.indexOf.empty() || level.next.empty())
+		return;
+
+	StateKey start = startState(level);
+	graph.indexOf[start] = 0;
+	graph.keys.push_back(start);
+	graph.depth.push_back(0);
+	bool splits = !level.splits.empty();
+	if (splits)
+		graph.twin.push_back(0);
+	for (size_t i=0; i<graph.keys.size(); i++)
+	{
+		StateKey key = graph.keys[i];
+		for (int dir=0; dir<4; dir++)
+		{
+			StateKey to;
+			int result = stepState(level, key, dir, &to);
+			if (result == REST_WIN)
+			{
+				if (graph.optimal < 0)
+					graph.optimal = graph.depth[i] + 1;
+				graph.next.push_back(GRAPH_WIN);
+				continue;
+			}
+			if (result == REST_FALL)
+			{
+				// Landing upright on a tile that only holds a lying block
+				int pose = level.next[(size_t)statePose(level, key)*4 + dir];
+				bool broke = pose >= 0 && !level.isSplitPose(pose) && pose % 3 == 0
+					&& tileKinds[level.cells[pose / 3]].support == SUPPORT_LYING;
+				graph.next.push_back(broke ? GRAPH_BREAK : GRAPH_FALL);
+				continue;
+			}
+			if (graph.indexOf[to] < 0)
+			{
+				graph.indexOf[to] = graph.keys.size();
+				graph.keys.push_back(to);
+				graph.depth.push_back(graph.depth[i] + 1);
+				if (splits)
+				{
+					// The twin is as far from the start, so it goes in the same layer
+					int at = graph.indexOf[to];
+					StateKey twin = swapState(level, to);
+					graph.twin.push_back(at);
+					if (twin != to)
+					{
+						graph.twin[at] = graph.keys.size();
+						graph.indexOf[twin] = graph.keys.size();
+						graph.keys.push_back(twin);
+						graph.depth.push_back(graph.depth[i] + 1);
+						graph.twin.push_back(at);
+					}
+				}
+			}
+			graph.next.push_back(graph.indexOf[to]);
+		}
+	}
+}
+
+void winDistances(const StateGraph &graph, std::vector<int32_t> &dist)
+{
+	int n = graph.size();
+	dist.assign(n, -1);
+	// Reverse edges, grouped by target
+	std::vector<int32_t> first(n + 1, 0), from(graph.next.size());
+	for (size_t e=0; e<graph.next.size(); e++)
+		if (graph.next[e] >= 0)
+			first[graph.next[e] + 1]++;
+	for (int i=0; i<n; i++)
+		first[i+1] += first[i];
+	std::vector<int32_t> fill(first.begin(), first.end() - 1);
+	std::vector<int32_t> queue;
+	// A state and its twin are the same distance from the goal
+	bool twins = !graph.twin.empty();
+	for (size_t e=0; e<graph.next.size(); e++)
+	{
+		int i = e / 4;
+		if (graph.next[e] >= 0)
+			from[fill[graph.next[e]]++] = i;
+		else if (graph.next[e] == GRAPH_WIN && dist[i] < 0)
+		{
+			dist[i] = 1;
+			queue.push_back(i);
+		}
+	}
+	// Breadth-first backwards from the states next to the goal
+	for (size_t head=0; head<queue.size(); head++)
+	{
+		int i = queue[head];
+		for (int e=first[i]; e<first[i+1]; e++)
+			if (dist[from[e]] < 0)
+			{
+				int j = from[e];
+				dist[j] = dist[i] + 1;
+				queue.push_back(j);
+				if (twins && dist[graph.twin[j]] < 0)
+				{
+					dist[graph.twin[j]] = dist[j];
+					queue.push_back(graph.twin[j]);
+				}
+			}
+	}
+}
+
+void winnableStates(const StateGraph &graph, std::vector<uint8_t> &canWin)
+{
+	std::vector<int32_t> dist;
+	winDistances(graph, dist);
+	canWin.resize(dist.size());
+	for (size_t i=0; i<dist.size(); i++)
+		canWin[i] = dist[i] >= 0;
+}
+
+void findLiveStates(Level &level)
+{
+	StateGraph graph;
+	buildGraph(level, graph);
+	std::vector<int32_t> dist;
+	winDistances(graph, dist);
+	level.live.assign(((size_t)stateCount(level) + 63) / 64, 0);
+	level.reached.assign(level.cells.size(), 0);
+	level.reachableStates = graph.size();
+	level.deadStates = 0;
+	for (int i=0; i<graph.size(); i++)
+	{
+		StateKey key = graph.keys[i];
+		int rows[2], cols[2];
+		int n = level.poseCells(statePose(level, key), rows, cols);
+		for (int c=0; c<n; c++)
+			level.reached[rows[c]*level.width + cols[c]] = 1;
+		// Winning ends the game on the goal and a split tile splits the
+		// block at once, so neither pose is ever a state
+		for (int dir=0; dir<4; dir++)
+			if (graph.next[i*4 + dir] >= 0 || graph.next[i*4 + dir] == GRAPH_WIN)
+			{
+				int landed = level.next[(size_t)statePose(level, key)*4 + dir];
+				n = level.poseCells(landed, rows, cols);
+				for (int c=0; c<n; c++)
+					level.reached[rows[c]*level.width + cols[c]] = 1;
+			}
+		if (dist[i] >= 0)
+			level.live[key >> 6] |= 1ull << (key & 63);
+		else
+			level.deadStates++;
+	}
+	level.unreachableTiles = 0;
+	for (size_t c=0; c<level.cells.size(); c++)
+		level.unreachableTiles += level.cells[c] != TILE_EMPTY && !level.reached[c];
+}
@@ -0,0 +1,48 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "level.h"
+#include "rules.h"
+
+/* The reachable part of a level's state graph, built once by breadth-first
+ * search and then walked by the analysis tools. States are numbered in the
+ * order the search reached them, so depth never decreases with the index
+ * and state 0 is the start. */
+
+/* StateGraph::next entries for rolls that don't land on a state */
+#define GRAPH_FALL -1
+#define GRAPH_BREAK -2		// stood up on a fragile tile
+#define GRAPH_WIN -3
+
+struct StateGraph {
+	std::vector<StateKey> keys;
+	std::vector<int32_t> next;		// next[i*4 + dir]: state index or GRAPH_*
+	std::vector<int32_t> depth;		// moves from the start
+	/* twin[i]: state i with the other cube moving next, a free change;
+	 * i for a whole block. Empty for levels without splits. */
+	std::vector<int32_t> twin;
+	int optimal;					// moves to win, -1 if it can't be won
+
+	int size() const { return keys.size(); }
+
+	/* StateKey -> index, -1 if unreached; kept between builds to save
+	 * reallocating it */
+	std::vector<int32_t> indexOf;
+};
+
+/* Search every state reachable from level's start; level must be compiled */
+void buildGraph(const Level &level, StateGraph &graph);
+
+/* dist[i] is the fewest moves to win from state i, -1 if it can't be won */
+void winDistances(const StateGraph &graph, std::vector<int32_t> &dist);
+/* canWin[i] is 1 if the goal can still be reached from state i */
+void winnableStates(const StateGraph &graph, std::vector<uint8_t> &canWin);
+
+/* Fills level's live, reached and dead counts from both searches; run by
+ * compileLevel() once the transition table is built */
+void findLiveStates(Level &level);
+
+#endif
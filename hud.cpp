@@ -0,0 +1,143 @@
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include "hud.h"
+
+/* Single producer (game loop) / single consumer (logger thread) ring.
+ * Indices only ever grow; the slot is index & (HUD_QUEUE_SIZE-1). */
+#define HUD_QUEUE_SIZE 256
+
+static HudEvent queue[HUD_QUEUE_SIZE];
+static std::atomic<unsigned> head(0), tail(0);
+static std::atomic<bool> running(false);
+static std::atomic<unsigned> dropped(0);
+static std::thread logger;
+static int hudFormat = HUD_FORMAT_STATUS;
+
+static int lastLevel = -1, lastMoves = -1, lastSecond = -1;
+
+static const char *eventName(int kind)
+{
+	switch (kind) {
+		case HUD_STATUS: return "status";
+		case HUD_LEVEL_START: return "level_start";
+		case HUD_LEVEL_WON: return "level_won";
+		case HUD_LEVEL_FAILED: return "level_failed";
+		case HUD_GAME_OVER: return "game_over";
+		case HUD_LEVEL_RELOADED: return "level_reloaded";
+		case HUD_LEVEL_EDITED: return "level_edited";
+		default: return "unknown";
+	}
+}
+
+static void writeEvent(const HudEvent &e)
+{
+	if (hudFormat == HUD_FORMAT_EVENTS)
+	{
+		if (e.kind == HUD_LEVEL_RELOADED)
+			printf("event=%s level=%d moves=%d time=%.3f ms=%.1f\n", eventName(e.kind), e.level, e.moves, e.time, e.took);
+		else
+			printf("event=%s level=%d moves=%d time=%.3f\n", eventName(e.kind), e.level, e.moves, e.time);
+		fflush(stdout);
+	}
+	else if (hudFormat == HUD_FORMAT_STATUS && e.kind == HUD_STATUS)
+	{
+		printf("\r||TIME = %d||  ||NUMBER OF MOVES = %d||", (int)e.time, e.moves);
+		fflush(stdout);
+	}
+	else if (hudFormat == HUD_FORMAT_STATUS && e.kind == HUD_LEVEL_EDITED)
+	{
+		// On its own line; the next status rewrites the one after it
+		if (e.moves < 0)
+			printf("\nedited level %d: can't be won\n", e.level);
+		else
+			printf("\nedited level %d: optimal %d moves\n", e.level, e.moves);
+		fflush(stdout);
+	}
+	else if (hudFormat == HUD_FORMAT_STATUS && e.kind == HUD_LEVEL_RELOADED)
+	{
+		printf("\nreloaded level %d: optimal %d moves, %.1f ms\n", e.level, e.moves, e.took);
+		fflush(stdout);
+	}
+}
+
+static void drain()
+{
+	unsigned t = tail.load(std::memory_order_relaxed);
+	unsigned h = head.load(std::memory_order_acquire);
+	for (; t != h; t++)
+		writeEvent(queue[t & (HUD_QUEUE_SIZE-1)]);
+	tail.store(t, std::memory_order_release);
+}
+
+static void loggerMain()
+{
+	while (running.load(std::memory_order_acquire))
+	{
+		drain();
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	drain();
+	if (dropped.load() && hudFormat != HUD_FORMAT_NONE)
+		fprintf(stderr, "\nhud: dropped %u events\n", dropped.load());
+}
+
+int hudParseFormat(const char *name)
+{
+	if (!strcmp(name, "events"))
+		return HUD_FORMAT_EVENTS;
+	if (!strcmp(name, "none") || !strcmp(name, "window"))
+		return HUD_FORMAT_NONE;
+	return HUD_FORMAT_STATUS;
+}
+
+void hudStart(int format)
+{
+	if (running.load())
+		return;
+	hudFormat = format;
+	running.store(true, std::memory_order_release);
+	logger = std::thread(loggerMain);
+}
+
+void hudPost(int kind, int level, int moves, double time, double took)
+{
+	unsigned h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) >= HUD_QUEUE_SIZE)
+	{
+		/* Never block the frame on a slow consumer */
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	HudEvent &e = queue[h & (HUD_QUEUE_SIZE-1)];
+	e.kind = kind;
+	e.level = level;
+	e.moves = moves;
+	e.time = time;
+	e.took = took;
+	head.store(h + 1, std::memory_order_release);
+}
+
+bool hudStatus(int level, int moves, double time)
+{
+	int second = (int)time;
+	if (level == lastLevel && moves == lastMoves && second == lastSecond)
+		return false;
+	lastLevel = level;
+	lastMoves = moves;
+	lastSecond = second;
+	hudPost(HUD_STATUS, level, moves, time);
+	return true;
+}
+
+void hudStop()
+{
+	if (!running.exchange(false))
+		return;
+	logger.join();
+	if (hudFormat == HUD_FORMAT_STATUS)
+		printf("\n");
+}
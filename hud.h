@@ -0,0 +1,41 @@
+#ifndef HUD_H
+#define HUD_H
+
+/* Status reporting for the game loop.
+ * The loop only posts small events into a lock-free queue; a background
+ * thread formats them and writes them out, so a slow pipe never stalls a frame. */
+
+enum HudFormat {
+	HUD_FORMAT_STATUS,	// legacy "||TIME = ..||" line rewritten in place with '\r'
+	HUD_FORMAT_EVENTS,	// one structured key=value line per event, for log collectors
+	HUD_FORMAT_NONE		// nothing on the terminal (used with the in-window HUD)
+};
+
+enum HudEventKind {
+	HUD_STATUS,
+	HUD_LEVEL_START,
+	HUD_LEVEL_WON,
+	HUD_LEVEL_FAILED,
+	HUD_GAME_OVER,
+	HUD_LEVEL_RELOADED,	// moves carries the new optimal move count
+	HUD_LEVEL_EDITED	// moves carries the optimal move count, -1 if it can't be won
+};
+
+struct HudEvent {
+	int kind;
+	int level;
+	int moves;
+	double time;
+	double took;	// HUD_LEVEL_RELOADED: ms from the file being saved to the level in play
+};
+
+void hudStart(int format);
+void hudPost(int kind, int level, int moves, double time, double took = 0);
+/* Posts a HUD_STATUS event only when level, moves or whole seconds changed.
+ * Returns true if something was posted, so callers can refresh other HUDs too. */
+bool hudStatus(int level, int moves, double time);
+/* Drains the queue and joins the logger thread. Safe to call more than once. */
+void hudStop();
+int hudParseFormat(const char *name);
+
+#endif
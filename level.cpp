@@ -0,0 +1,654 @@
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include "level.h"
+#include "pack.h"
+#include "graph.h"
+
+const Roll rollTable[4][4] = {
+	// up         down         left         right
+	{ {0, 1, 2}, {0, -2, 2}, {-2, 0, 1}, {1, 0, 1} },	// standing
+	{ {0, 1, 1}, {0, -1, 1}, {-1, 0, 0}, {2, 0, 0} },	// lying along x
+	{ {0, 2, 0}, {0, -1, 0}, {-1, 0, 2}, {1, 0, 2} },	// lying along y
+	{ {0, 1, 3}, {0, -1, 3}, {-1, 0, 3}, {1, 0, 3} }	// one cube of a split block
+};
+
+void defaultManifest(std::vector<LevelEntry> &entries)
+{
+	static const char *files[] = { "level01.txt", "level04.txt", "level10.txt", "level03.txt", "level09.txt" };
+	entries.clear();
+	for (int i=0; i<5; i++)
+	{
+		LevelEntry e;
+		e.file = files[i];
+		e.name = files[i];
+		e.par = 0;
+		entries.push_back(e);
+	}
+}
+
+bool loadManifest(const char *path, std::vector<LevelEntry> &entries)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+		return false;
+	entries.clear();
+	char line[512];
+	while (fgets(line, sizeof(line), file))
+	{
+		char *hash = strchr(line, '#');
+		if (hash)
+			*hash = 0;
+		char name[256], fname[256];
+		int par = 0, used = 0;
+		if (sscanf(line, "%255s %d %n", fname, &par, &used) < 2)
+		{
+			if (sscanf(line, "%255s", fname) == 1)
+				fprintf(stderr, "%s: ignoring line without a par count: %s", path, line);
+			continue;
+		}
+		LevelEntry e;
+		e.file = fname;
+		e.par = par;
+		name[0] = 0;
+		sscanf(line + used, "%255[^\n]", name);
+		e.name = name[0] ? name : fname;
+		entries.push_back(e);
+	}
+	fclose(file);
+	return true;
+}
+
+void Level::resize(int w, int h)
+{
+	cells.assign((size_t)w*h, TILE_EMPTY);
+	setShape(w, h);
+}
+
+void Level::setShape(int w, int h)
+{
+	width = w;
+	height = h;
+	if (w <= LEVEL_SMALL && h <= LEVEL_SMALL)
+		originX = originY = LEVEL_ORIGIN;
+	else
+	{
+		originX = w/2;
+		originY = h/2;
+	}
+}
+
+/* Reports a parse error, at most a screenful per file */
+static void levelError(const char *path, int line, int col, int *errors, const char *what, int c)
+{
+	if (++*errors <= 20)
+	{
+		if (c >= 0)
+			fprintf(stderr, "%s:%d:%d: %s '%c'\n", path, line, col, what, c);
+		else
+			fprintf(stderr, "%s:%d:%d: %s\n", path, line, col, what);
+	}
+}
+
+static bool linkOrder(const SwitchLink &a, const SwitchLink &b)
+{
+	return a.cell < b.cell;
+}
+
+static bool bridgeOrder(const BridgeLink &a, const BridgeLink &b)
+{
+	return a.cell < b.cell;
+}
+
+static bool splitOrder(const SplitLink &a, const SplitLink &b)
+{
+	return a.cell < b.cell;
+}
+
+uint32_t Level::switchToggles(int row, int col) const
+{
+	SwitchLink key = { row*width + col, 0 };
+	std::vector<SwitchLink>::const_iterator it = std::lower_bound(switches.begin(), switches.end(), key, linkOrder);
+	return it != switches.end() && it->cell == key.cell ? it->toggles : 0;
+}
+
+int Level::bridgeGroup(int row, int col) const
+{
+	BridgeLink key = { row*width + col, 0 };
+	std::vector<BridgeLink>::const_iterator it = std::lower_bound(bridges.begin(), bridges.end(), key, bridgeOrder);
+	return it != bridges.end() && it->cell == key.cell ? it->group : -1;
+}
+
+const SplitLink *Level::splitAt(int cell) const
+{
+	SplitLink key = { cell, {0, 0} };
+	std::vector<SplitLink>::const_iterator it = std::lower_bound(splits.begin(), splits.end(), key, splitOrder);
+	return it != splits.end() && it->cell == cell ? &*it : NULL;
+}
+
+void finishBindings(Level &level)
+{
+	std::sort(level.switches.begin(), level.switches.end(), linkOrder);
+	std::sort(level.bridges.begin(), level.bridges.end(), bridgeOrder);
+	int groups = 0;
+	bool any = false;
+	size_t listedSwitches = level.switches.size(), listedBridges = level.bridges.size();
+	for (int cell=0; cell<(int)level.cells.size(); cell++)
+	{
+		int trigger = tileKinds[level.cells[cell]].trigger;
+		if (trigger == TRIGGER_SWITCH || trigger == TRIGGER_HARD_SWITCH)
+		{
+			any = true;
+			if (!std::binary_search(level.switches.begin(), level.switches.begin() + listedSwitches, SwitchLink{cell, 0}, linkOrder))
+				level.switches.push_back(SwitchLink{cell, 1});
+		}
+		else if (tileKinds[level.cells[cell]].support == SUPPORT_EXTENDED)
+		{
+			any = true;
+			if (!std::binary_search(level.bridges.begin(), level.bridges.begin() + listedBridges, BridgeLink{cell, 0}, bridgeOrder))
+				level.bridges.push_back(BridgeLink{cell, 0});
+		}
+	}
+	std::sort(level.switches.begin(), level.switches.end(), linkOrder);
+	std::sort(level.bridges.begin(), level.bridges.end(), bridgeOrder);
+	for (size_t i=0; i<level.switches.size(); i++)
+		for (int g=0; g<LEVEL_MAX_GROUPS; g++)
+			if (level.switches[i].toggles & (1u << g) && g+1 > groups)
+				groups = g+1;
+	for (size_t i=0; i<level.bridges.size(); i++)
+		if (level.bridges[i].group+1 > groups)
+			groups = level.bridges[i].group+1;
+	level.groups = any ? std::max(groups, 1) : 0;
+	level.startMask &= level.groups ? (1u << level.groups) - 1 : 0;
+
+	// Only links that can work are kept, so the rules never check them
+	int size = level.cells.size();
+	std::vector<SplitLink> splits;
+	for (size_t i=0; i<level.splits.size(); i++)
+	{
+		const SplitLink &s = level.splits[i];
+		if (s.cell >= 0 && s.cell < size && tileKinds[level.cells[s.cell]].trigger == TRIGGER_SPLIT
+			&& s.cubes[0] >= 0 && s.cubes[0] < size && s.cubes[1] >= 0 && s.cubes[1] < size && s.cubes[0] != s.cubes[1])
+			splits.push_back(s);
+	}
+	std::sort(splits.begin(), splits.end(), splitOrder);
+	level.splits.swap(splits);
+	level.floorIndex.clear();
+	level.floorCells.clear();
+	if (!level.splits.empty())
+	{
+		level.floorIndex.assign(size, -1);
+		for (int cell=0; cell<size; cell++)
+			if (tileKinds[level.cells[cell]].support != SUPPORT_NONE)
+			{
+				level.floorIndex[cell] = level.floorCells.size();
+				level.floorCells.push_back(cell);
+			}
+	}
+}
+
+/* The @bridge / @switch / @split lines after the grid. line is the file line of text[from]. */
+static void parseBindings(const char *path, const std::vector<char> &text, size_t from, int line, Level &level, int *errors)
+{
+	uint32_t declared = 0, on = 0;
+	level.switches.clear();
+	level.bridges.clear();
+	level.splits.clear();
+	level.startMask = 0;
+	while (from < text.size())
+	{
+		size_t end = from;
+		while (end < text.size() && text[end] != '\n')
+			end++;
+		std::string directive(text.begin() + from, text.begin() + end);
+		from = end + 1;
+		size_t hash = directive.find('#');
+		if (hash != std::string::npos)
+			directive.erase(hash);
+
+		char word[16], state[8];
+		int used = 0;
+		const char *p = directive.c_str();
+		if (sscanf(p, " %15s %n", word, &used) < 1)
+		{
+			line++;
+			continue;
+		}
+		p += used;
+		int group, row, col, row1, col1, row2, col2;
+		if (!strcmp(word, "@bridge") && sscanf(p, "%d %7s %n", &group, state, &used) == 2
+			&& group >= 0 && group < LEVEL_MAX_GROUPS && (!strcmp(state, "on") || !strcmp(state, "off")))
+		{
+			p += used;
+			bool extended = !strcmp(state, "on");
+			if ((declared >> group & 1) && (on >> group & 1) != extended)
+				levelError(path, line, 1, errors, "bridge group declared both on and off", -1);
+			declared |= 1u << group;
+			if (extended)
+				on |= 1u << group;
+			while (sscanf(p, "%d %d %n", &row, &col, &used) == 2)
+			{
+				p += used;
+				if (!level.inside(row-1, col-1) || tileKinds[level.at(row-1, col-1)].support != SUPPORT_EXTENDED)
+					levelError(path, line, 1, errors, "@bridge names a cell that isn't a bridge", -1);
+				else
+					level.bridges.push_back(BridgeLink{(row-1)*level.width + col-1, group});
+			}
+			if (*p)
+				levelError(path, line, 1, errors, "bad @bridge cell list", -1);
+		}
+		else if (!strcmp(word, "@switch") && sscanf(p, "%d %d %n", &row, &col, &used) == 2)
+		{
+			p += used;
+			int trigger = tileKinds[level.at(row-1, col-1)].trigger;
+			if (trigger != TRIGGER_SWITCH && trigger != TRIGGER_HARD_SWITCH)
+				levelError(path, line, 1, errors, "@switch names a cell that isn't a switch", -1);
+			uint32_t toggles = 0;
+			while (sscanf(p, "%d %n", &group, &used) == 1 && group >= 0 && group < LEVEL_MAX_GROUPS)
+			{
+				p += used;
+				toggles |= 1u << group;
+			}
+			if (*p || !toggles)
+				levelError(path, line, 1, errors, "bad @switch group list", -1);
+			else if (level.inside(row-1, col-1))
+				level.switches.push_back(SwitchLink{(row-1)*level.width + col-1, toggles});
+		}
+		else if (!strcmp(word, "@split") && sscanf(p, "%d %d %d %d %d %d %n", &row, &col, &row1, &col1, &row2, &col2, &used) == 6)
+		{
+			p += used;
+			if (tileKinds[level.at(row-1, col-1)].trigger != TRIGGER_SPLIT)
+				levelError(path, line, 1, errors, "@split names a cell that isn't a split tile", -1);
+			else if (!level.inside(row1-1, col1-1) || !level.inside(row2-1, col2-1) || (row1 == row2 && col1 == col2))
+				levelError(path, line, 1, errors, "@split needs two different cells on the board", -1);
+			else if (level.splitAt((row-1)*level.width + col-1))
+				levelError(path, line, 1, errors, "second @split for this tile", -1);
+			else
+			{
+				SplitLink s = { (row-1)*level.width + col-1, { (row1-1)*level.width + col1-1, (row2-1)*level.width + col2-1 } };
+				// Kept sorted as they come, for splitAt() above
+				level.splits.insert(std::upper_bound(level.splits.begin(), level.splits.end(), s, splitOrder), s);
+			}
+			if (*p)
+				levelError(path, line, 1, errors, "bad @split line", -1);
+		}
+		else
+			levelError(path, line, 1, errors, "unknown binding", -1);
+		line++;
+	}
+	// Undeclared group 0 starts extended, like the single bridge set of the original game
+	level.startMask = on | (declared & 1 ? 0 : 1);
+	finishBindings(level);
+	for (int cell=0; cell<(int)level.cells.size(); cell++)
+		if (tileKinds[level.cells[cell]].trigger == TRIGGER_SPLIT && !level.splitAt(cell))
+			levelError(path, cell / level.width + 1, cell % level.width + 1, errors, "split tile without an @split line", -1);
+	if (!stateSpaceFits(level))
+		levelError(path, line, 1, errors, level.splits.empty() ? "too many bridge groups for a board this size"
+			: "too many floor tiles and bridge groups for a level with split tiles", -1);
+}
+
+bool parseLevel(const char *path, Level &level)
+{
+	FILE *file = fopen(path, "rb");
+	if (!file)
+	{
+		fprintf(stderr, "Could not open level %s\n", path);
+		return false;
+	}
+	std::vector<char> text;
+	char chunk[65536];
+	size_t got;
+	while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+		text.insert(text.end(), chunk, chunk + got);
+	fclose(file);
+
+	// Single pass: the first row fixes the width, later rows are checked
+	// against it and appended straight into the flat cell array.
+	std::vector<uint8_t> &cells = level.cells;
+	cells.clear();
+	int width = -1, height = 0, col = 0, spaces = 0, errors = 0, starts = 0, goals = 0;
+	size_t bindAt = text.size();
+	level.startRow = level.startCol = 0;
+	for (size_t i=0; i<=text.size(); i++)
+	{
+		int c = i < text.size() ? (unsigned char)text[i] : '\n';
+		// A blank line or an '@' line ends the grid
+		if (col == 0 && spaces == 0 && width >= 0 && (c == '@' || c == '\n'))
+		{
+			bindAt = i;
+			break;
+		}
+		if (c == '\n')
+		{
+			if (col == 0 && i == text.size())
+				break;
+			if (width < 0)
+				width = col;
+			else if (col < width)
+			{
+				levelError(path, height+1, col+1, &errors, "row is shorter than the first row", -1);
+				cells.resize(cells.size() + width - col, TILE_EMPTY);
+			}
+			height++;
+			col = spaces = 0;
+			if (width == 0 || width > LEVEL_MAX_SIZE || height > LEVEL_MAX_SIZE)
+			{
+				levelError(path, height, 1, &errors, "bad level size", -1);
+				break;
+			}
+			continue;
+		}
+		if (c == '\r')
+			continue;
+		// Trailing spaces are tolerated, anything after them isn't
+		if (c == ' ')
+		{
+			spaces++;
+			continue;
+		}
+		if (spaces)
+		{
+			levelError(path, height+1, col+1, &errors, "space inside a row", -1);
+			spaces = 0;
+		}
+		int tile = glyphTile(c);
+		if (tile < 0)
+		{
+			levelError(path, height+1, col+1, &errors, "unknown tile", c);
+			tile = TILE_EMPTY;
+		}
+		if (width >= 0 && col >= width)
+		{
+			if (col == width)
+				levelError(path, height+1, col+1, &errors, "row is wider than the first row", -1);
+			col++;
+			continue;
+		}
+		if (c == GLYPH_START)
+		{
+			if (starts++)
+				levelError(path, height+1, col+1, &errors, "second start tile", c);
+			level.startRow = height;
+			level.startCol = col;
+		}
+		else if (tile == TILE_GOAL)
+			goals++;
+		cells.push_back(tile);
+		col++;
+	}
+	level.setShape(width, height);
+	parseBindings(path, text, bindAt, height+1, level, &errors);
+	if (!errors && !starts)
+		levelError(path, height, 1, &errors, "no start tile", GLYPH_START);
+	if (!errors && !goals)
+		levelError(path, height, 1, &errors, "no goal tile", -1);
+	if (errors)
+	{
+		if (errors > 20)
+			fprintf(stderr, "%s: %d errors\n", path, errors);
+		return false;
+	}
+	return true;
+}
+
+bool checkLevel(const Level &level, const char *where)
+{
+	bool ok = true;
+	if (level.width < 1 || level.height < 1 || level.width > LEVEL_MAX_SIZE || level.height > LEVEL_MAX_SIZE
+		|| level.cells.size() != (size_t)level.width*level.height)
+	{
+		fprintf(stderr, "%s: bad level size\n", where);
+		return false;
+	}
+	if (!level.inside(level.startRow, level.startCol))
+	{
+		fprintf(stderr, "%s: start off the board\n", where);
+		ok = false;
+	}
+	bool goal = false, unbound = false;
+	for (int cell=0; cell<(int)level.cells.size(); cell++)
+	{
+		goal |= level.cells[cell] == TILE_GOAL;
+		unbound |= tileKinds[level.cells[cell]].trigger == TRIGGER_SPLIT && !level.splitAt(cell);
+	}
+	if (!goal)
+	{
+		fprintf(stderr, "%s: no goal tile\n", where);
+		ok = false;
+	}
+	if (unbound)
+	{
+		fprintf(stderr, "%s: split tile without an @split line\n", where);
+		ok = false;
+	}
+	if (!stateSpaceFits(level))
+	{
+		fprintf(stderr, "%s: too many states for a board this size\n", where);
+		ok = false;
+	}
+	return ok;
+}
+
+int Level::poseCells(int pose, int rows[2], int cols[2]) const
+{
+	if (isSplitPose(pose))
+	{
+		int floor = floorCells.size();
+		int cell = floorCells[(pose - wholePoses()) / floor], other = floorCells[(pose - wholePoses()) % floor];
+		rows[0] = cell / width;
+		cols[0] = cell % width;
+		rows[1] = other / width;
+		cols[1] = other % width;
+		return 2;
+	}
+	int orientation = pose % 3;
+	int cell = pose / 3;
+	rows[0] = cell / width;
+	cols[0] = cell % width;
+	if (orientation == 0)
+		return 1;
+	rows[1] = rows[0] - (orientation == 2);
+	cols[1] = cols[0] - (orientation == 1);
+	return 2;
+}
+
+static bool tileOrder(const TileDraw &a, const TileDraw &b)
+{
+	return a.type < b.type || (a.type == b.type && a.groups < b.groups);
+}
+
+void buildTransitions(Level &level)
+{
+	level.next.assign((size_t)level.poseCount()*4, -1);
+	for (int pose=0; pose<level.wholePoses(); pose++)
+	{
+		int orientation = pose % 3;
+		int row = pose / 3 / level.width, col = pose / 3 % level.width;
+		for (int dir=0; dir<4; dir++)
+		{
+			const Roll &r = rollTable[orientation][dir];
+			int nrow = row - r.dy, ncol = col - r.dx;
+			if (!level.inside(nrow, ncol))
+				continue;
+			int to = level.poseIndex(nrow, ncol, r.orientation);
+			int rows[2], cols[2];
+			int n = level.poseCells(to, rows, cols);
+			if (n == 2 && !level.inside(rows[1], cols[1]))
+				continue;
+			level.next[(size_t)pose*4 + dir] = to;
+		}
+	}
+	// One cube rolls onto another floor cell; never onto the other cube,
+	// which it would have joined next to
+	int floor = level.floorCells.size();
+	for (int a=0; a<floor; a++)
+		for (int b=0; b<floor; b++)
+		{
+			int pose = level.wholePoses() + a*floor + b;
+			int row = level.floorCells[a] / level.width, col = level.floorCells[a] % level.width;
+			for (int dir=0; dir<4; dir++)
+			{
+				const Roll &r = rollTable[ORIENT_SPLIT][dir];
+				int nrow = row - r.dy, ncol = col - r.dx;
+				if (!level.inside(nrow, ncol))
+					continue;
+				int cell = nrow*level.width + ncol;
+				if (level.floorIndex[cell] >= 0 && cell != level.floorCells[b])
+					level.next[(size_t)pose*4 + dir] = level.wholePoses() + level.floorIndex[cell]*floor + b;
+			}
+		}
+}
+
+void compileLevel(Level &level)
+{
+	buildTransitions(level);
+	findLiveStates(level);
+	buildTileList(level);
+}
+
+void buildTileList(Level &level)
+{
+	// The goal stays even if it can't be reached, so the board still reads
+	bool all = level.reached.empty();
+	level.tiles.clear();
+	for (int i=0; i<level.height; i++)
+		for (int j=0; j<level.width; j++)
+			if (level.at(i, j) != TILE_EMPTY && (all || level.reached[i*level.width + j] || level.at(i, j) == TILE_GOAL))
+			{
+				TileDraw t;
+				t.x = level.originX - j;
+				t.y = level.originY - i;
+				t.type = level.at(i, j);
+				t.groups = 0;
+				if (tileKinds[t.type].support == SUPPORT_EXTENDED)
+					t.groups = 1u << level.bridgeGroup(i, j);
+				else if (tileKinds[t.type].trigger == TRIGGER_SWITCH || tileKinds[t.type].trigger == TRIGGER_HARD_SWITCH)
+					t.groups = level.switchToggles(i, j);
+				level.tiles.push_back(t);
+			}
+	std::stable_sort(level.tiles.begin(), level.tiles.end(), tileOrder);
+
+	// Bridge ranges per group, so the renderer picks groups by mask
+	level.groupFirst.assign(level.groups + 1, 0);
+	size_t i = 0;
+	while (i < level.tiles.size() && level.tiles[i].type < TILE_BRIDGE)
+		i++;
+	for (int g=0; g<level.groups; g++)
+	{
+		level.groupFirst[g] = i;
+		while (i < level.tiles.size() && level.tiles[i].type == TILE_BRIDGE && level.tiles[i].groups == (1u << g))
+			i++;
+	}
+	level.groupFirst[level.groups] = i;
+}
+
+void warnLevel(const Level &level, const char *path)
+{
+	if (level.reached.empty())
+		return;
+	int shown = 0;
+	for (int i=0; i<level.height; i++)
+		for (int j=0; j<level.width; j++)
+			if (level.at(i, j) != TILE_EMPTY && !level.reached[i*level.width + j] && ++shown <= 20)
+				fprintf(stderr, "%s:%d:%d: warning: the block can never rest on this %s tile\n", path, i+1, j+1,
+					tileKinds[level.at(i, j)].name);
+	if (shown > 20)
+		fprintf(stderr, "%s: warning: %d more unreachable tiles\n", path, shown - 20);
+	if (level.deadStates == level.reachableStates)
+		fprintf(stderr, "%s: warning: the goal can't be reached\n", path);
+	else if (level.deadStates)
+		fprintf(stderr, "%s: warning: the goal can't be reached from %d of %d reachable states\n", path,
+			level.deadStates, level.reachableStates);
+}
+
+bool loadLevel(const LevelEntry &entry, Level &level)
+{
+	std::string pack;
+	int index;
+	if (isPackEntry(entry.file, &pack, &index))
+	{
+		if (!loadPackLevel(pack, index, level))
+			return false;
+	}
+	else if (!parseLevel(entry.file.c_str(), level))
+		return false;
+	level.name = entry.name;
+	level.par = entry.par;
+	compileLevel(level);
+	return true;
+}
+
+LevelLoader::LevelLoader(const std::vector<LevelEntry> &e)
+	: entries(e), requested(-1), loading(-1), readyIndex(-1), readyOk(false), quit(false)
+{
+	worker = std::thread(&LevelLoader::run, this);
+}
+
+LevelLoader::~LevelLoader()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	worker.join();
+}
+
+void LevelLoader::prefetch(int index)
+{
+	if (index < 0 || index >= (int)entries.size())
+		return;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (readyIndex == index || loading == index)
+			return;
+		requested = index;
+	}
+	wake.notify_all();
+}
+
+bool LevelLoader::take(int index, Level &level)
+{
+	if (index < 0 || index >= (int)entries.size())
+		return false;
+	std::unique_lock<std::mutex> guard(lock);
+	if (requested == index)
+		requested = -1;
+	while (loading == index)
+		wake.wait(guard);
+	if (readyIndex == index)
+	{
+		std::swap(level, ready);
+		readyIndex = -1;
+		return readyOk;
+	}
+	guard.unlock();
+	return loadLevel(entries[index], level);
+}
+
+void LevelLoader::run()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for (;;)
+	{
+		while (!quit && requested < 0)
+			wake.wait(guard);
+		if (quit)
+			return;
+		int index = requested;
+		loading = index;
+		requested = -1;
+		guard.unlock();
+
+		Level level;
+		bool ok = loadLevel(entries[index], level);
+
+		guard.lock();
+		std::swap(ready, level);
+		readyIndex = index;
+		readyOk = ok;
+		loading = -1;
+		wake.notify_all();
+	}
+}
@@ -0,0 +1,246 @@
+#ifndef LEVEL_H
+#define LEVEL_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "tiles.h"
+
+/* Level data shared by the game and the tools. Nothing in here touches GL,
+ * so levels can be parsed and compiled on a background thread. */
+
+/* Levels up to 20x20 keep the original layout, with world position of
+ * cell (row, col) at (LEVEL_ORIGIN-col, LEVEL_ORIGIN-row). Bigger ones are
+ * centred on the world origin. */
+#define LEVEL_ORIGIN 4
+#define LEVEL_SMALL 20
+/* Keeps pose indices (cells*3) well inside an int */
+#define LEVEL_MAX_SIZE 4096
+
+/* Same order as lastkey-1 in the game */
+enum Direction {
+	DIR_UP = 0,
+	DIR_DOWN,
+	DIR_LEFT,
+	DIR_RIGHT,
+	DIR_SWAP		// not a roll: the other cube of a split block takes over
+};
+
+/* How the block rolls: world dx, dy and new orientation, indexed by
+ * [orientation][direction]. Orientation 0 is standing, 1 lying along x
+ * (covers x and x+1), 2 lying along y (covers y and y+1), and
+ * ORIENT_SPLIT a block split into two cubes, of which one rolls a cell
+ * at a time. */
+struct Roll {
+	int dx, dy, orientation;
+};
+#define ORIENT_SPLIT 3
+extern const Roll rollTable[4][4];
+
+/* Bridge groups a level can have; the switch state is a bitmask of the
+ * extended groups. */
+#define LEVEL_MAX_GROUPS 16
+
+/* One tile of the board as the renderer wants it */
+struct TileDraw {
+	float x, y;
+	int type;
+	uint32_t groups;	// bridge: its group bit, switch: the groups it toggles
+};
+
+struct SwitchLink {
+	int cell;
+	uint32_t toggles;
+};
+
+struct BridgeLink {
+	int cell;
+	int group;
+};
+
+struct SplitLink {
+	int cell;
+	int cubes[2];	// cells the cubes land on; the first one moves first
+};
+
+struct Level {
+	int width, height;
+	int originX, originY;		// world x of column c is originX-c, world y of row r is originY-r
+	std::vector<uint8_t> cells;	// TileType per cell, row-major, width*height
+	int startRow, startCol;
+
+	/* Switch to bridge-group bindings, both sorted by cell. A switch not
+	 * listed toggles group 0 and a bridge not listed is in group 0. */
+	int groups;				// number of bridge groups, 0 without bridges or switches
+	uint32_t startMask;		// groups extended when the level starts
+	std::vector<SwitchLink> switches;
+	std::vector<BridgeLink> bridges;
+	/* Split tiles and their targets, sorted by cell. A split tile not
+	 * listed doesn't split the block. */
+	std::vector<SplitLink> splits;
+	/* With splits, the cells a cube can rest on (any tile but empty)
+	 * numbered from 0, and each cell's number or -1; empty otherwise */
+	std::vector<int32_t> floorIndex;
+	std::vector<int32_t> floorCells;
+
+	Level() : width(0), height(0), originX(LEVEL_ORIGIN), originY(LEVEL_ORIGIN), startRow(0), startCol(0), groups(0), startMask(0), reachableStates(0), deadStates(0), unreachableTiles(0), par(0) {}
+
+	bool inside(int row, int col) const
+	{
+		return (unsigned)row < (unsigned)height && (unsigned)col < (unsigned)width;
+	}
+	/* Anything off the board reads as empty, so callers never index out of bounds */
+	int at(int row, int col) const
+	{
+		return inside(row, col) ? cells[row*width + col] : (int)TILE_EMPTY;
+	}
+	/* Tile under world position (x, y) */
+	int atWorld(int x, int y) const
+	{
+		return at(originY - y, originX - x);
+	}
+	/* A pose is a block position plus orientation, packed as
+	 * (row*width + col)*3 + orientation. A level with splits has a pose
+	 * for every ordered pair of floor cells after those, for the moving
+	 * cube and the other one of a split block. */
+	int wholePoses() const
+	{
+		return width*height*3;
+	}
+	int poseCount() const
+	{
+		return wholePoses() + (int)(floorCells.size()*floorCells.size());
+	}
+	int poseIndex(int row, int col, int orientation) const
+	{
+		return (row*width + col)*3 + orientation;
+	}
+	bool isSplitPose(int pose) const
+	{
+		return pose >= wholePoses();
+	}
+	/* Split pose with the cube on cell moving next; both must be floor */
+	int splitPose(int cell, int otherCell) const
+	{
+		return wholePoses() + floorIndex[cell]*(int)floorCells.size() + floorIndex[otherCell];
+	}
+	/* Grid cells covered by a pose; returns how many (1 or 2). A split
+	 * pose gives the moving cube first. */
+	int poseCells(int pose, int rows[2], int cols[2]) const;
+	uint32_t switchToggles(int row, int col) const;
+	int bridgeGroup(int row, int col) const;
+	/* NULL if cell isn't a bound split tile */
+	const SplitLink *splitAt(int cell) const;
+	/* Empty board of w x h */
+	void resize(int w, int h);
+	/* Size and origin only, for callers that filled cells themselves */
+	void setShape(int w, int h);
+
+	/* Filled by compileLevel() */
+	std::vector<int> next;			// next[pose*4+dir]: pose after rolling, -1 if it leaves the grid
+	std::vector<TileDraw> tiles;	// non-empty tiles, sorted by type then group
+	/* tiles[groupFirst[g] .. groupFirst[g+1]) are the bridges of group g */
+	std::vector<int> groupFirst;
+	/* Reachability from the start: a state is live if the block can get
+	 * there and still win from it, dead if it can get there but can't win */
+	std::vector<uint64_t> live;		// bit per state key, empty if never searched
+	std::vector<uint8_t> reached;	// per cell, 1 if the block can come to rest on it
+	int reachableStates, deadStates;
+	int unreachableTiles;			// non-empty cells the block never rests on
+
+	bool isLive(uint32_t key) const
+	{
+		return live.empty() || (live[key >> 6] >> (key & 63) & 1);
+	}
+
+	std::string name;
+	int par;
+};
+
+/* One line of the level manifest */
+struct LevelEntry {
+	std::string file;
+	std::string name;
+	int par;		// designer's target move count, 0 if unknown
+};
+
+/* Reads "file par name..." lines; '#' starts a comment. Returns false if
+ * the manifest can't be opened, in which case the built-in order is used. */
+bool loadManifest(const char *path, std::vector<LevelEntry> &entries);
+/* The five shipped levels in their original order */
+void defaultManifest(std::vector<LevelEntry> &entries);
+
+/* Reads a level file in one pass. Every character must be a tile glyph
+ * from tileKinds; bad glyphs, ragged rows and a missing or repeated start
+ * are reported as path:line:col and make it return false.
+ *
+ * The grid may be followed by binding lines (rows and columns count from 1):
+ *   @bridge <group> <on|off> <row> <col> [<row> <col> ...]
+ *   @switch <row> <col> <group> [<group> ...]
+ *   @split <row> <col> <row> <col> <row> <col>
+ * Without them every switch toggles group 0, which holds every bridge and
+ * starts extended, as in the original game. Every split tile needs an
+ * @split line giving the two cells its cubes land on. */
+bool parseLevel(const char *path, Level &level);
+/* What parseLevel checks of the finished level, for levels that come from
+ * elsewhere (packs): a size up to LEVEL_MAX_SIZE, the start on the board,
+ * a goal, every split tile bound and few enough states for a StateKey.
+ * Prints each problem as "where: problem"; needs finishBindings. */
+bool checkLevel(const Level &level, const char *where);
+/* Poses << groups fits the 31 bits of a StateKey */
+inline bool stateSpaceFits(const Level &level)
+{
+	long long floor = level.floorCells.size();
+	return ((long long)level.width*level.height*3 + floor*floor) << level.groups <= 0x7fffffffLL;
+}
+/* Sorts the bindings and gives unlisted switches and bridges group 0;
+ * sets groups and, if there are splits, numbers the floor. For code that
+ * builds a Level by hand. */
+void finishBindings(Level &level);
+/* Just the pose transition table, for searches that need nothing else */
+void buildTransitions(Level &level);
+/* Builds the pose transition table, searches the reachable states and
+ * builds the render tile list, leaving out tiles the block never rests on
+ * (except the goal) */
+void compileLevel(Level &level);
+/* The render tile list and bridge ranges alone; every tile goes in when
+ * reached is empty */
+void buildTileList(Level &level);
+/* Warnings for the level's author on stderr: tiles the block can never
+ * rest on as path:line:col, and reachable states the goal can't be
+ * reached from. Needs a compiled level. */
+void warnLevel(const Level &level, const char *path);
+/* parseLevel (or a pack lookup for "file.pack:N") + compileLevel for a manifest entry */
+bool loadLevel(const LevelEntry &entry, Level &level);
+
+/* Parses and compiles levels on a worker thread, so the next level is
+ * ready before the current one ends. */
+class LevelLoader {
+public:
+	LevelLoader(const std::vector<LevelEntry> &entries);
+	~LevelLoader();
+	/* Start loading entry index in the background (no-op if out of range) */
+	void prefetch(int index);
+	/* Hand over entry index, waiting for the worker if it is still on it and
+	 * loading synchronously if it was never prefetched */
+	bool take(int index, Level &level);
+private:
+	void run();
+
+	std::vector<LevelEntry> entries;
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake;
+	int requested;		// index the worker should load next, -1 for none
+	int loading;		// index the worker is busy with, -1 for none
+	int readyIndex;		// index held in ready, -1 for none
+	bool readyOk;
+	bool quit;
+	Level ready;
+};
+
+#endif
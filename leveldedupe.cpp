@@ -0,0 +1,156 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+#include "level.h"
+#include "pack.h"
+#include "zobrist.h"
+#include "steal.h"
+
+/* Removes levels that play the same as an earlier one from a pack.
+ *
+ *   leveldedupe [-t threads] [-x] [-v] in.pack out.pack
+ *
+ * Levels are the same when one is the other moved, rotated, mirrored or
+ * with its bridge groups renumbered (see zobrist.h). The first level of
+ * each class is kept, as it was, with its stored optimal count. Canonical
+ * hashes are computed on all cores; classes are found with a flat
+ * open-addressing table of the 64-bit hashes, which is trusted unless -x
+ * asks to compare the boards of every match. -v lists the duplicates. */
+
+/* Levels per pool task */
+#define DEDUPE_TASK 1024
+
+/* Hash -> first level with it. Key 0 marks a free slot. */
+class HashSet {
+public:
+	explicit HashSet(size_t count)
+	{
+		size_t capacity = 16;
+		while (capacity < count*2)
+			capacity *= 2;
+		keys.assign(capacity, 0);
+		values.resize(capacity);
+		mask = capacity - 1;
+	}
+	/* Slot of key at or after slot start, or the free slot it would go in */
+	size_t find(uint64_t key, size_t start) const
+	{
+		size_t slot = start & mask;
+		while (keys[slot] && keys[slot] != key)
+			slot = (slot + 1) & mask;
+		return slot;
+	}
+	size_t next(size_t slot) const { return (slot + 1) & mask; }
+	bool used(size_t slot) const { return keys[slot] != 0; }
+	uint32_t value(size_t slot) const { return values[slot]; }
+	void insert(size_t slot, uint64_t key, uint32_t value)
+	{
+		keys[slot] = key;
+		values[slot] = value;
+	}
+private:
+	std::vector<uint64_t> keys;
+	std::vector<uint32_t> values;
+	size_t mask;
+};
+
+static void usage()
+{
+	fprintf(stderr, "usage: leveldedupe [-t threads] [-x] [-v] in.pack out.pack\n");
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 0;
+	bool verify = false, list = false;
+	int i = 1;
+	for (; i<argc && argv[i][0] == '-'; i++)
+	{
+		if (!strcmp(argv[i], "-t") && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-x"))
+			verify = true;
+		else if (!strcmp(argv[i], "-v"))
+			list = true;
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	if (i+2 != argc)
+	{
+		usage();
+		return 2;
+	}
+	const char *in = argv[i], *out = argv[i+1];
+
+	LevelPack pack;
+	if (!pack.open(in))
+		return 1;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	int count = pack.count();
+	std::vector<uint64_t> hashes(count);
+	std::vector<uint8_t> bad(count, 0);
+	StealPool pool(threads);
+	std::vector<Level> decoded(pool.size()), canonical(pool.size());
+	pool.run((count + DEDUPE_TASK-1) / DEDUPE_TASK, [&](int task, int thread) {
+		int end = std::min(count, (task+1)*DEDUPE_TASK);
+		for (int n=task*DEDUPE_TASK; n<end; n++)
+		{
+			if (!pack.decode(n, decoded[thread]))
+			{
+				bad[n] = 1;
+				continue;
+			}
+			uint64_t h = canonicalLevel(decoded[thread], canonical[thread]);
+			hashes[n] = h ? h : 1;
+		}
+	});
+	double hashing = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	HashSet seen(count);
+	std::vector<int> keep;
+	Level a, b, ca, cb;
+	int corrupt = 0;
+	for (int n=0; n<count; n++)
+	{
+		if (bad[n])
+		{
+			corrupt++;
+			continue;
+		}
+		size_t slot = seen.find(hashes[n], hashes[n]);
+		while (verify && seen.used(slot))
+		{
+			// A different board with the same hash keeps probing
+			int first = seen.value(slot);
+			pack.decode(first, a);
+			pack.decode(n, b);
+			canonicalLevel(a, ca);
+			canonicalLevel(b, cb);
+			if (sameLevel(ca, cb))
+				break;
+			slot = seen.find(hashes[n], seen.next(slot));
+		}
+		if (seen.used(slot))
+		{
+			if (list)
+				printf("%d: same as %u\n", n, seen.value(slot));
+			continue;
+		}
+		seen.insert(slot, hashes[n], n);
+		keep.push_back(n);
+	}
+	if (!writePackSubset(out, pack, keep))
+		return 1;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	printf("%s: %d levels, %zu kept, %zu duplicates", in, count, keep.size(), count - corrupt - keep.size());
+	if (corrupt)
+		printf(", %d corrupt skipped", corrupt);
+	printf(" (%.2f s hashing on %d threads, %.2f s total)\n", hashing, pool.size(), seconds);
+	return 0;
+}
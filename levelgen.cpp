@@ -0,0 +1,334 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "level.h"
+#include "rules.h"
+#include "pack.h"
+#include "steal.h"
+#include "rng.h"
+
+/* Procedural level generator.
+ *
+ *   levelgen [-n levels] [-s seed] [-t threads] [-w width] [-h height]
+ *            [-o min:max] [-b min:max] [-f fragile%] [-g groups]
+ *            [-c candidates] out.pack
+ *
+ * Boards are carved by random walks of the block, so most are winnable,
+ * then get extra floor, fragile tiles and switch-operated bridges. Each
+ * candidate is searched exhaustively and kept only if its optimal solution
+ * is -o moves long and the mean number of safe rolls over every reachable
+ * state is within -b. The output pack stores the optimal move counts; play
+ * it with './sample2D --pack=out.pack'.
+ *
+ * Candidate i draws from its own random stream derived from the seed, and
+ * the kept levels are the first n in candidate order, so the same seed
+ * gives the same pack on any number of threads. Ranges no board of the
+ * size can meet would never finish, so it gives up after -c candidates. */
+
+/* Candidates per pool task; tasks per thread in a round */
+#define GEN_TASK 16
+#define GEN_ROUND_TASKS 16
+/* Walk steps tried before giving up on ending with the block standing */
+#define GEN_SETTLE_TRIES 64
+/* Default -c: a minute or so on one thread for boards that never pass */
+#define GEN_MAX_CANDIDATES 1000000
+
+struct GenOptions {
+	int width, height;
+	int minMoves, maxMoves;
+	double minBranch, maxBranch;
+	int fragile;		// percent of floor
+	int groups;			// most switch / bridge pairs per level
+};
+
+struct Candidate {
+	uint64_t index;
+	Level level;
+	int optimal;
+	double branching;
+	int states;
+};
+
+/* Per-thread search buffers */
+struct Scratch {
+	std::vector<int> depth;
+	std::vector<StateKey> queue;
+};
+
+/* Breadth-first search over every reachable state: the optimal move count
+ * (-1 if there is none), the reachable states and the mean number of rolls
+ * from them that don't fall */
+static int analyse(const Level &level, Scratch &s, int *states, double *branching)
+{
+	s.depth.assign(stateCount(level), -1);
+	s.queue.clear();
+	StateKey start = startState(level);
+	s.depth[start] = 0;
+	s.queue.push_back(start);
+	int optimal = -1;
+	long long safe = 0;
+	for (size_t head=0; head<s.queue.size(); head++)
+	{
+		StateKey key = s.queue[head];
+		for (int dir=0; dir<4; dir++)
+		{
+			StateKey to;
+			int result = stepState(level, key, dir, &to);
+			if (result == REST_WIN)
+			{
+				safe++;
+				if (optimal < 0)
+					optimal = s.depth[key] + 1;
+			}
+			else if (result == REST_OK)
+			{
+				safe++;
+				if (s.depth[to] < 0)
+				{
+					s.depth[to] = s.depth[key] + 1;
+					s.queue.push_back(to);
+				}
+			}
+		}
+	}
+	*states = s.queue.size();
+	*branching = (double)safe / s.queue.size();
+	return optimal;
+}
+
+static bool insidePose(int w, int h, int row, int col, int orientation)
+{
+	// Lying along x also covers col-1, along y row-1
+	int row2 = orientation == 2 ? row-1 : row, col2 = orientation == 1 ? col-1 : col;
+	return row2 >= 0 && col2 >= 0 && row < h && col < w;
+}
+
+/* One random board, cropped to its tiles; false if the walk got stuck */
+static bool carve(const GenOptions &o, Rng &rng, Level &level)
+{
+	int w = o.width, h = o.height;
+	std::vector<uint8_t> grid((size_t)w*h, TILE_EMPTY);
+	std::vector<int> path;		// cells in the order the walk covered them
+	int row = 1 + rng.below(h-2), col = 1 + rng.below(w-2), orientation = 0;
+	int startCell = row*w + col;
+	grid[startCell] = TILE_SOLID;
+	path.push_back(startCell);
+
+	int steps = o.minMoves + rng.below(o.maxMoves*2 - o.minMoves + 1);
+	for (int i=0; i<steps + GEN_SETTLE_TRIES && (i < steps || orientation != 0); i++)
+	{
+		int dir = rng.below(4);
+		const Roll &r = rollTable[orientation][dir];
+		int nrow = row - r.dy, ncol = col - r.dx;
+		if (!insidePose(w, h, nrow, ncol, r.orientation))
+			continue;
+		row = nrow;
+		col = ncol;
+		orientation = r.orientation;
+		int cells[2] = { row*w + col, -1 };
+		if (orientation == 1)
+			cells[1] = row*w + col-1;
+		else if (orientation == 2)
+			cells[1] = (row-1)*w + col;
+		for (int c=0; c<2 && cells[c] >= 0; c++)
+			if (grid[cells[c]] == TILE_EMPTY)
+			{
+				grid[cells[c]] = TILE_SOLID;
+				path.push_back(cells[c]);
+			}
+	}
+	int goalCell = row*w + col;
+	if (orientation != 0 || goalCell == startCell)
+		return false;
+	grid[goalCell] = TILE_GOAL;
+
+	// Spare floor next to the path gives the player choices
+	int extra = path.size() / 4 + rng.below(path.size() / 2 + 1);
+	for (int i=0; i<extra; i++)
+	{
+		int cell = path[rng.below(path.size())];
+		int r = cell / w + rng.below(3) - 1, c = cell % w + rng.below(3) - 1;
+		if (r >= 0 && r < h && c >= 0 && c < w && grid[r*w + c] == TILE_EMPTY)
+			grid[r*w + c] = TILE_SOLID;
+	}
+	for (size_t i=0; i<grid.size(); i++)
+		if (grid[i] == TILE_SOLID && (int)i != startCell && rng.chance(o.fragile))
+			grid[i] = TILE_FRAGILE;
+
+	// A bridge on the later part of the path and a switch before it
+	std::vector<int8_t> group(grid.size(), -1);
+	std::vector<uint32_t> toggles(grid.size(), 0);
+	uint32_t startMask = 0;
+	int pairs = o.groups ? rng.below(o.groups + 1) : 0;
+	for (int g=0; g<pairs && path.size() > 8; g++)
+	{
+		int at = path.size()/2 + rng.below(path.size()/2);
+		int bridge = path[at], sw = path[1 + rng.below(at-1)];
+		if (bridge == goalCell || grid[bridge] == TILE_BRIDGE || grid[sw] == TILE_BRIDGE || sw == startCell || sw == goalCell)
+			continue;
+		grid[bridge] = TILE_BRIDGE;
+		group[bridge] = g;
+		if (at+1 < (int)path.size() && path[at+1] != goalCell && grid[path[at+1]] != TILE_BRIDGE && rng.chance(50))
+		{
+			grid[path[at+1]] = TILE_BRIDGE;
+			group[path[at+1]] = g;
+		}
+		grid[sw] = rng.chance(30) ? TILE_HARD_SWITCH : TILE_SWITCH;
+		toggles[sw] |= 1u << g;
+		if (rng.chance(25))
+			startMask |= 1u << g;
+	}
+
+	int top = h, bottom = 0, left = w, right = 0;
+	for (int r=0; r<h; r++)
+		for (int c=0; c<w; c++)
+			if (grid[r*w + c] != TILE_EMPTY)
+			{
+				top = std::min(top, r);
+				bottom = std::max(bottom, r);
+				left = std::min(left, c);
+				right = std::max(right, c);
+			}
+	level = Level();
+	level.resize(right-left+1, bottom-top+1);
+	for (int r=top; r<=bottom; r++)
+		for (int c=left; c<=right; c++)
+		{
+			int from = r*w + c, to = (r-top)*level.width + c-left;
+			level.cells[to] = grid[from];
+			if (group[from] >= 0)
+				level.bridges.push_back(BridgeLink{to, group[from]});
+			if (toggles[from])
+				level.switches.push_back(SwitchLink{to, toggles[from]});
+		}
+	level.startRow = startCell/w - top;
+	level.startCol = startCell%w - left;
+	level.startMask = startMask;
+	finishBindings(level);
+	buildTransitions(level);
+	return true;
+}
+
+static bool parseRange(const char *s, double *lo, double *hi)
+{
+	return sscanf(s, "%lf:%lf", lo, hi) == 2 && *lo <= *hi;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: levelgen [-n levels] [-s seed] [-t threads] [-w width] [-h height]\n"
+		"                [-o min:max] [-b min:max] [-f fragile%%] [-g groups]\n"
+		"                [-c candidates] out.pack\n");
+}
+
+int main(int argc, char **argv)
+{
+	int wanted = 20, threads = 0;
+	uint64_t seed = 1, candidates = GEN_MAX_CANDIDATES;
+	GenOptions o = { 14, 10, 10, 40, 1.5, 3.0, 10, 2 };
+	int i = 1;
+	for (; i<argc && argv[i][0] == '-'; i++)
+	{
+		double lo, hi;
+		if (!strcmp(argv[i], "-n") && i+1 < argc)
+			wanted = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i+1 < argc)
+			seed = strtoull(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-t") && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-w") && i+1 < argc)
+			o.width = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-h") && i+1 < argc)
+			o.height = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-o") && i+1 < argc && parseRange(argv[++i], &lo, &hi))
+		{
+			o.minMoves = lo;
+			o.maxMoves = hi;
+		}
+		else if (!strcmp(argv[i], "-b") && i+1 < argc && parseRange(argv[++i], &lo, &hi))
+		{
+			o.minBranch = lo;
+			o.maxBranch = hi;
+		}
+		else if (!strcmp(argv[i], "-f") && i+1 < argc)
+			o.fragile = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-g") && i+1 < argc)
+			o.groups = std::min(atoi(argv[++i]), LEVEL_MAX_GROUPS);
+		else if (!strcmp(argv[i], "-c") && i+1 < argc)
+			candidates = strtoull(argv[++i], NULL, 0);
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	if (i+1 != argc || wanted <= 0 || o.width < 3 || o.height < 3 || o.width > LEVEL_MAX_SIZE
+		|| o.height > LEVEL_MAX_SIZE || o.minMoves < 1 || !candidates)
+	{
+		usage();
+		return 2;
+	}
+	const char *out = argv[i];
+
+	StealPool pool(threads);
+	std::vector<Scratch> scratch(pool.size());
+	std::vector<Candidate> kept;
+	uint64_t tried = 0;
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	while ((int)kept.size() < wanted)
+	{
+		int tasks = pool.size() * GEN_ROUND_TASKS;
+		std::vector<std::vector<Candidate> > found(tasks);
+		pool.run(tasks, [&](int task, int thread) {
+			for (int n=0; n<GEN_TASK; n++)
+			{
+				uint64_t index = tried + (uint64_t)task*GEN_TASK + n;
+				Rng rng(seed, index);
+				Candidate c;
+				c.index = index;
+				if (!carve(o, rng, c.level))
+					continue;
+				c.optimal = analyse(c.level, scratch[thread], &c.states, &c.branching);
+				if (c.optimal < o.minMoves || c.optimal > o.maxMoves
+					|| c.branching < o.minBranch || c.branching > o.maxBranch)
+					continue;
+				// The transition table isn't stored in the pack
+				std::vector<int>().swap(c.level.next);
+				found[task].push_back(std::move(c));
+			}
+		});
+		// Tasks cover consecutive candidates, so this is candidate order
+		for (int t=0; t<tasks && (int)kept.size() < wanted; t++)
+			for (size_t n=0; n<found[t].size() && (int)kept.size() < wanted; n++)
+				kept.push_back(std::move(found[t][n]));
+		tried += (uint64_t)tasks*GEN_TASK;
+		if ((int)kept.size() < wanted && tried >= candidates)
+		{
+			fprintf(stderr, "levelgen: only %zu of %d levels in %llu candidates; widen -o or -b, or raise -c\n",
+				kept.size(), wanted, (unsigned long long)tried);
+			return 1;
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+	std::vector<Level> levels;
+	std::vector<int> optimal;
+	for (size_t n=0; n<kept.size(); n++)
+	{
+		const Candidate &c = kept[n];
+		printf("%zu: %dx%d optimal %d states %d branching %.2f groups %d (candidate %llu)\n", n,
+			c.level.width, c.level.height, c.optimal, c.states, c.branching, c.level.groups,
+			(unsigned long long)c.index);
+		levels.push_back(c.level);
+		optimal.push_back(c.optimal);
+	}
+	if (!writePack(out, levels, optimal))
+		return 1;
+	printf("%s: %zu levels from %llu candidates in %.2f s on %d threads\n", out, levels.size(),
+		(unsigned long long)tried, seconds, pool.size());
+	return 0;
+}
@@ -0,0 +1,243 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+#include "level.h"
+#include "pack.h"
+#include "graph.h"
+#include "solver.h"
+#include "steal.h"
+
+/* Difficulty metrics from each level's full state graph, for choosing
+ * level order.
+ *
+ *   levelmetrics [-t threads] [-j] [-d] [-m manifest | levels.pack]
+ *
+ * One CSV row (or with -j one JSON object per line) per level, in level
+ * order, written as soon as every level before it is done:
+ *
+ *   states          reachable states (pose and switch mask)
+ *   optimal         moves to win, -1 if it can't be won
+ *   solutions       distinct optimal move sequences, exact however many
+ *   dead_ends       share of reachable states the goal can't be reached from
+ *   branching       mean rolls per reachable state that don't fall
+ *   fragile_traps   share of reachable states with a roll that breaks a
+ *                   fragile tile
+ *   switch_toggles  fewest switch presses on an optimal solution
+ *   distances       with -d: reachable states 0, 1, 2... moves from the
+ *                   start, space separated in CSV, an array in JSON
+ *
+ * Levels run in parallel on a work-stealing pool; timing goes to stderr. */
+
+struct Metrics {
+	int states, optimal;
+	WideCount solutions;
+	double deadEnds, branching, fragileTraps;
+	int switchToggles;
+	std::vector<int> distances;
+};
+
+/* Per-thread buffers, reused from level to level */
+struct Scratch {
+	Level level;
+	StateGraph graph;
+	std::vector<uint8_t> canWin;
+	SolveStats stats;
+	std::vector<int> toggles;
+};
+
+static void measure(const Level &level, Scratch &s, Metrics &m)
+{
+	const StateGraph &g = s.graph;
+	buildGraph(level, s.graph);
+	winnableStates(g, s.canWin);
+	int n = g.size();
+	m.states = n;
+	m.optimal = g.optimal;
+
+	long long safe = 0;
+	int dead = 0, traps = 0;
+	for (int i=0; i<n; i++)
+	{
+		bool trap = false;
+		for (int dir=0; dir<4; dir++)
+		{
+			int to = g.next[i*4 + dir];
+			safe += to >= 0 || to == GRAPH_WIN;
+			trap |= to == GRAPH_BREAK;
+		}
+		traps += trap;
+		dead += !s.canWin[i];
+	}
+	m.branching = n ? (double)safe / n : 0;
+	m.deadEnds = n ? (double)dead / n : 0;
+	m.fragileTraps = n ? (double)traps / n : 0;
+	// BFS order, so each distance is one run of states
+	m.distances.clear();
+	for (int i=0; i<n; i++)
+	{
+		if (g.depth[i] == (int)m.distances.size())
+			m.distances.push_back(0);
+		m.distances.back()++;
+	}
+
+	// The solution count is the solver's, so the two can't disagree
+	solveStats(level, s.stats, false);
+	m.solutions = s.stats.solutions;
+
+	// Fewest toggles along shortest paths, layer by layer
+	m.switchToggles = -1;
+	if (g.optimal < 0)
+		return;
+	uint32_t maskBits = (1u << level.groups) - 1;
+	s.toggles.assign(n, INT32_MAX);
+	s.toggles[0] = 0;
+	for (int i=0; i<n && g.depth[i] < g.optimal; i++)
+	{
+		// A split block and its twin are one position, reached the same ways
+		if (!g.twin.empty() && g.twin[i] > i)
+		{
+			int j = g.twin[i];
+			s.toggles[i] = s.toggles[j] = std::min(s.toggles[i], s.toggles[j]);
+		}
+		if (s.toggles[i] == INT32_MAX)
+			continue;	// not on a shortest path to anywhere useful
+		for (int dir=0; dir<4; dir++)
+		{
+			int to = g.next[i*4 + dir];
+			if (to == GRAPH_WIN && (s.toggles[i] < m.switchToggles || m.switchToggles < 0))
+				m.switchToggles = s.toggles[i];
+			if (to < 0 || g.depth[to] != g.depth[i] + 1)
+				continue;
+			int t = s.toggles[i] + ((g.keys[i] ^ g.keys[to]) & maskBits ? 1 : 0);
+			if (t < s.toggles[to])
+				s.toggles[to] = t;
+		}
+	}
+}
+
+static std::string format(bool json, bool distances, int index, const std::string &name, const Level &level, const Metrics &m)
+{
+	char fields[512];
+	if (json)
+		snprintf(fields, sizeof(fields), "{\"level\": %d, \"name\": \"%s\", \"width\": %d, \"height\": %d, \"states\": %d, "
+			"\"optimal\": %d, \"solutions\": %s, \"dead_ends\": %.4f, \"branching\": %.3f, "
+			"\"fragile_traps\": %.4f, \"switch_toggles\": %d",
+			index, name.c_str(), level.width, level.height, m.states, m.optimal, m.solutions.str().c_str(),
+			m.deadEnds, m.branching, m.fragileTraps, m.switchToggles);
+	else
+		snprintf(fields, sizeof(fields), "%d,%s,%d,%d,%d,%d,%s,%.4f,%.3f,%.4f,%d",
+			index, name.c_str(), level.width, level.height, m.states, m.optimal, m.solutions.str().c_str(),
+			m.deadEnds, m.branching, m.fragileTraps, m.switchToggles);
+	std::string line = fields;
+	if (distances)
+	{
+		line += json ? ", \"distances\": [" : ",";
+		for (size_t d=0; d<m.distances.size(); d++)
+		{
+			if (d)
+				line += json ? ", " : " ";
+			line += std::to_string(m.distances[d]);
+		}
+		if (json)
+			line += "]";
+	}
+	line += json ? "}\n" : "\n";
+	return line;
+}
+
+int main(int argc, char **argv)
+{
+	int threads = 0;
+	bool json = false, distances = false;
+	const char *manifestPath = NULL, *packPath = NULL;
+	for (int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-t") && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-j"))
+			json = true;
+		else if (!strcmp(argv[i], "-d"))
+			distances = true;
+		else if (!strcmp(argv[i], "-m") && i+1 < argc)
+			manifestPath = argv[++i];
+		else if (argv[i][0] != '-' && !packPath)
+			packPath = argv[i];
+		else
+		{
+			fprintf(stderr, "usage: levelmetrics [-t threads] [-j] [-d] [-m manifest | levels.pack]\n");
+			return 2;
+		}
+	}
+
+	LevelPack pack;
+	std::vector<LevelEntry> manifest;
+	int count;
+	if (packPath)
+	{
+		if (!pack.open(packPath))
+			return 1;
+		count = pack.count();
+	}
+	else
+	{
+		if (!loadManifest(manifestPath ? manifestPath : "manifest.txt", manifest))
+			defaultManifest(manifest);
+		count = manifest.size();
+	}
+
+	if (!json)
+		printf("level,name,width,height,states,optimal,solutions,dead_ends,branching,fragile_traps,switch_toggles%s\n",
+			distances ? ",distances" : "");
+	// Rows finish out of order; each is printed once all before it are
+	std::vector<std::string> rows(count);
+	std::vector<uint8_t> ready(count, 0);
+	int printed = 0;
+	std::mutex outLock;
+
+	StealPool pool(threads);
+	std::vector<Scratch> scratch(pool.size());
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	pool.run(count, [&](int n, int thread) {
+		Scratch &s = scratch[thread];
+		std::string name;
+		bool ok;
+		if (packPath)
+		{
+			name = std::string(packPath) + ":" + std::to_string(n);
+			ok = pack.decode(n, s.level);
+			if (ok)
+				compileLevel(s.level);
+		}
+		else
+		{
+			name = manifest[n].file;
+			ok = loadLevel(manifest[n], s.level);
+		}
+		std::string row;
+		if (ok)
+		{
+			Metrics m;
+			measure(s.level, s, m);
+			row = format(json, distances, n, name, s.level, m);
+		}
+		else
+			fprintf(stderr, "%s: can't be loaded\n", name.c_str());
+
+		std::lock_guard<std::mutex> hold(outLock);
+		rows[n].swap(row);
+		ready[n] = 1;
+		for (; printed < count && ready[printed]; printed++)
+		{
+			fputs(rows[printed].c_str(), stdout);
+			std::string().swap(rows[printed]);
+		}
+	});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	fprintf(stderr, "%d levels in %.2f s on %d threads, %.0f levels/s\n", count, seconds, pool.size(), count / seconds);
+	return 0;
+}
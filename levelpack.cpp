@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "level.h"
+#include "pack.h"
+#include "solver.h"
+
+/* Converts levelNN.txt files into a binary pack, or lists a pack.
+ *
+ *   levelpack [-s] out.pack level.txt...     pack the given levels
+ *   levelpack [-s] -m manifest.txt out.pack  pack the levels of a manifest
+ *   levelpack -l in.pack                     list a pack
+ *
+ * -s runs the solver and stores each level's optimal move count, warning
+ * about tiles that can never be reached on the way. */
+
+static void usage()
+{
+	fprintf(stderr, "usage: levelpack [-s] [-m manifest] out.pack [level.txt ...]\n"
+		"       levelpack -l in.pack\n");
+}
+
+static int list(const char *path)
+{
+	LevelPack pack;
+	if (!pack.open(path))
+		return 1;
+	for (int i=0; i<pack.count(); i++)
+	{
+		PackLevelView v;
+		if (!pack.view(i, v))
+		{
+			printf("%d: corrupt\n", i);
+			continue;
+		}
+		printf("%d: %dx%d start %d,%d", i, v.info->width, v.info->height, v.info->startRow, v.info->startCol);
+		if (v.optimal >= 0)
+			printf(" optimal %d", v.optimal);
+		else if (v.optimal == PACK_UNSOLVABLE)
+			printf(" unsolvable");
+		printf("\n");
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	bool solve = false;
+	const char *manifestPath = NULL;
+	int i = 1;
+	for (; i<argc && argv[i][0] == '-'; i++)
+	{
+		if (!strcmp(argv[i], "-s"))
+			solve = true;
+		else if (!strcmp(argv[i], "-m") && i+1 < argc)
+			manifestPath = argv[++i];
+		else if (!strcmp(argv[i], "-l") && i+1 < argc)
+			return list(argv[i+1]);
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	if (i >= argc)
+	{
+		usage();
+		return 2;
+	}
+	const char *out = argv[i++];
+
+	std::vector<LevelEntry> entries;
+	if (manifestPath && !loadManifest(manifestPath, entries))
+	{
+		fprintf(stderr, "Could not open manifest %s\n", manifestPath);
+		return 1;
+	}
+	for (; i<argc; i++)
+	{
+		LevelEntry e;
+		e.file = argv[i];
+		e.name = argv[i];
+		e.par = 0;
+		entries.push_back(e);
+	}
+
+	std::vector<Level> levels(entries.size());
+	std::vector<int> optimal;
+	for (size_t n=0; n<entries.size(); n++)
+	{
+		if (!solve)
+		{
+			std::string pack;
+			int index;
+			bool ok = isPackEntry(entries[n].file, &pack, &index) ? loadPackLevel(pack, index, levels[n])
+				: parseLevel(entries[n].file.c_str(), levels[n]);
+			if (!ok)
+				return 1;
+			continue;
+		}
+		if (!loadLevel(entries[n], levels[n]))
+			return 1;
+		warnLevel(levels[n], entries[n].file.c_str());
+		int moves = solveLevel(levels[n]);
+		optimal.push_back(moves < 0 ? PACK_UNSOLVABLE : moves);
+		// The transition table isn't stored, don't keep it around
+		std::vector<int>().swap(levels[n].next);
+		std::vector<TileDraw>().swap(levels[n].tiles);
+		std::vector<uint64_t>().swap(levels[n].live);
+	}
+	if (!writePack(out, levels, optimal))
+		return 1;
+	printf("%s: %zu levels\n", out, levels.size());
+	return 0;
+}
@@ -0,0 +1,359 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "level.h"
+#include "pack.h"
+#include "graph.h"
+#include "rules.h"
+#include "rng.h"
+
+/* Monte Carlo estimate of how hard a level feels: plays many games with a
+ * noisy player and reports how often they win within K moves and where
+ * they fall.
+ *
+ *   levelrollout [-n games] [-k moves] [-e epsilon] [-s seed] [-t threads]
+ *                [-m manifest | levels.pack]
+ *
+ * The player is epsilon-greedy: with probability epsilon it rolls any way
+ * at random, otherwise it takes a roll on a shortest way to the goal
+ * (choosing at random between equals), or any safe roll from a state the
+ * goal can't be reached from. -e 1 is uniform random play. A game ends on
+ * a win, a fall or after -k moves. With a split block the player first
+ * picks the cube to move: at random when rolling at random, otherwise the
+ * one with the better rolls. Swapping cubes isn't a move.
+ *
+ * Games run on the reachable state graph, one table lookup per roll. Every
+ * thread keeps its own counters and claims chunks of games with one atomic
+ * add; the counters are summed at the end. Game i of a level draws from
+ * its own stream of the seed, so results don't depend on the threads. */
+
+/* Games claimed at a time */
+#define ROLLOUT_CHUNK 4096
+/* Death tiles listed per level */
+#define ROLLOUT_DEATHS 5
+
+struct Counters {
+	std::vector<uint64_t> winsAt;	// winsAt[m]: games won on move m
+	std::vector<uint64_t> deaths;	// per cell, the last entry for off the grid
+	uint64_t timeouts, moves;
+	char pad[64];					// keeps the next thread's counters off this line
+};
+
+/* The level as the rollouts see it */
+struct Table {
+	std::vector<int32_t> next;		// StateGraph::next, or the death cell as -4-cell
+	std::vector<uint8_t> greedy;	// per state, bit per direction the player likes
+	std::vector<int32_t> twin;		// StateGraph::twin, state itself for a whole block
+	std::vector<int32_t> handOver;	// per state, the twin if the greedy player would swap
+	int offGrid;					// death index for leaving the grid
+};
+
+/* nth set bit of a 4-bit mask, for n below its popcount */
+static uint8_t pickBit[16][4];
+
+static void initPickBit()
+{
+	for (int mask=1; mask<16; mask++)
+	{
+		int bits[4], n = 0;
+		for (int b=0; b<4; b++)
+			if (mask & (1 << b))
+				bits[n++] = b;
+		for (int r=0; r<4; r++)
+			pickBit[mask][r] = bits[r % n];
+	}
+}
+
+/* The cell the block falls through when rolling dir from key, -1 off the grid */
+static int deathCell(const Level &level, StateKey key, int dir)
+{
+	int pose = level.next[(size_t)statePose(level, key)*4 + dir];
+	if (pose < 0)
+		return -1;
+	int rows[2], cols[2];
+	int cells = level.poseCells(pose, rows, cols);
+	uint32_t mask = stateMask(level, key);
+	for (int c=0; c<cells; c++)
+	{
+		const TileKind &k = tileKinds[level.at(rows[c], cols[c])];
+		bool holds = k.support == SUPPORT_ALWAYS || (k.support == SUPPORT_LYING && cells == 2)
+			|| (k.support == SUPPORT_EXTENDED && mask & (1u << level.bridgeGroup(rows[c], cols[c])));
+		if (!holds)
+			return rows[c]*level.width + cols[c];
+	}
+	// The split tile held; the fall is the cube it sent onto a cell that doesn't
+	const SplitLink *s = cells == 1 ? level.splitAt(rows[0]*level.width + cols[0]) : NULL;
+	for (int c=0; s && c<2; c++)
+	{
+		uint32_t toggle;
+		if (restCube(level, s->cubes[c] / level.width, s->cubes[c] % level.width, mask, &toggle) != REST_OK)
+			return s->cubes[c];
+	}
+	return rows[0]*level.width + cols[0];
+}
+
+static void buildTable(const Level &level, const StateGraph &g, Table &t)
+{
+	std::vector<int32_t> dist;
+	winDistances(g, dist);
+	int n = g.size();
+	t.offGrid = level.width*level.height;
+	t.next = g.next;
+	t.greedy.assign(n, 0);
+	std::vector<uint8_t> rank(n);		// 2 with a best roll, 1 a safe one
+	for (int i=0; i<n; i++)
+	{
+		uint8_t best = 0, safe = 0;
+		for (int dir=0; dir<4; dir++)
+		{
+			int to = g.next[i*4 + dir];
+			if (to == GRAPH_WIN || (to >= 0 && dist[i] > 0 && dist[to] == dist[i] - 1))
+				best |= 1 << dir;
+			if (to >= 0 || to == GRAPH_WIN)
+				safe |= 1 << dir;
+			if (to == GRAPH_FALL || to == GRAPH_BREAK)
+			{
+				int cell = deathCell(level, g.keys[i], dir);
+				t.next[i*4 + dir] = -4 - (cell < 0 ? t.offGrid : cell);
+			}
+		}
+		t.greedy[i] = best ? best : safe ? safe : 15;
+		rank[i] = best ? 2 : safe ? 1 : 0;
+	}
+	t.twin.resize(n);
+	t.handOver.resize(n);
+	for (int i=0; i<n; i++)
+	{
+		t.twin[i] = g.twin.empty() ? i : g.twin[i];
+		t.handOver[i] = rank[t.twin[i]] > rank[i] ? t.twin[i] : i;
+	}
+}
+
+static void play(const Table &t, uint64_t seed, uint64_t level, uint64_t first, uint64_t last,
+	int maxMoves, uint32_t randomBelow, Counters &c)
+{
+	const int32_t *next = &t.next[0];
+	const uint8_t *greedy = &t.greedy[0];
+	const int32_t *twin = &t.twin[0], *handOver = &t.handOver[0];
+	uint64_t moves = 0;
+	for (uint64_t game=first; game<last; game++)
+	{
+		Rng rng(seed ^ level << 40, game);
+		int state = 0, m = 0;
+		for (;;)
+		{
+			if (m == maxMoves)
+			{
+				c.timeouts++;
+				break;
+			}
+			uint64_t r = rng.next();
+			int dir;
+			if ((uint32_t)r < randomBelow)
+			{
+				state = r >> 34 & 1 ? twin[state] : state;
+				dir = r >> 32 & 3;
+			}
+			else
+			{
+				state = handOver[state];
+				dir = pickBit[greedy[state]][r >> 32 & 3];
+			}
+			int to = next[state*4 + dir];
+			m++;
+			if (to >= 0)
+			{
+				state = to;
+				continue;
+			}
+			if (to == GRAPH_WIN)
+				c.winsAt[m]++;
+			else
+				c.deaths[-4 - to]++;
+			break;
+		}
+		moves += m;
+	}
+	c.moves += moves;
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: levelrollout [-n games] [-k moves] [-e epsilon] [-s seed] [-t threads]\n"
+		"                    [-m manifest | levels.pack]\n");
+}
+
+int main(int argc, char **argv)
+{
+	long long games = 1000000;
+	int maxMoves = 200, threads = 0;
+	double epsilon = 0.25;
+	uint64_t seed = 1;
+	const char *manifestPath = NULL, *packPath = NULL;
+	for (int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i+1 < argc)
+			games = atoll(argv[++i]);
+		else if (!strcmp(argv[i], "-k") && i+1 < argc)
+			maxMoves = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-e") && i+1 < argc)
+			epsilon = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-s") && i+1 < argc)
+			seed = strtoull(argv[++i], NULL, 0);
+		else if (!strcmp(argv[i], "-t") && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-m") && i+1 < argc)
+			manifestPath = argv[++i];
+		else if (argv[i][0] != '-' && !packPath)
+			packPath = argv[i];
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	if (games <= 0 || maxMoves <= 0 || epsilon < 0 || epsilon > 1)
+	{
+		usage();
+		return 2;
+	}
+	if (threads <= 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	uint32_t randomBelow = epsilon >= 1 ? UINT32_MAX : (uint32_t)(epsilon * 4294967296.0);
+	initPickBit();
+
+	LevelPack pack;
+	std::vector<LevelEntry> manifest;
+	int count;
+	if (packPath)
+	{
+		if (!pack.open(packPath))
+			return 1;
+		count = pack.count();
+	}
+	else
+	{
+		if (!loadManifest(manifestPath ? manifestPath : "manifest.txt", manifest))
+			defaultManifest(manifest);
+		count = manifest.size();
+	}
+
+	Level level;
+	StateGraph graph;
+	Table table;
+	std::vector<Counters> counters(threads);
+	uint64_t totalGames = 0, totalMoves = 0;
+	double totalSeconds = 0;
+	for (int n=0; n<count; n++)
+	{
+		std::string name = packPath ? std::string(packPath) + ":" + std::to_string(n) : manifest[n].file;
+		bool ok = packPath ? pack.decode(n, level) : loadLevel(manifest[n], level);
+		if (!ok)
+		{
+			fprintf(stderr, "%s: can't be loaded\n", name.c_str());
+			continue;
+		}
+		if (packPath)
+			compileLevel(level);
+		buildGraph(level, graph);
+		if (graph.size() == 0)
+			continue;
+		buildTable(level, graph, table);
+
+		for (int t=0; t<threads; t++)
+		{
+			counters[t].winsAt.assign(maxMoves + 1, 0);
+			counters[t].deaths.assign(table.offGrid + 1, 0);
+			counters[t].timeouts = counters[t].moves = 0;
+		}
+		std::atomic<long long> claimed(0);
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		std::vector<std::thread> workers;
+		for (int t=0; t<threads; t++)
+			workers.push_back(std::thread([&, t]() {
+				for (;;)
+				{
+					long long first = claimed.fetch_add(ROLLOUT_CHUNK);
+					if (first >= games)
+						return;
+					play(table, seed, n, first, std::min(games, first + ROLLOUT_CHUNK), maxMoves, randomBelow, counters[t]);
+				}
+			}));
+		for (int t=0; t<threads; t++)
+			workers[t].join();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+		Counters sum = counters[0];
+		for (int t=1; t<threads; t++)
+		{
+			for (int m=0; m<=maxMoves; m++)
+				sum.winsAt[m] += counters[t].winsAt[m];
+			for (int d=0; d<=table.offGrid; d++)
+				sum.deaths[d] += counters[t].deaths[d];
+			sum.timeouts += counters[t].timeouts;
+			sum.moves += counters[t].moves;
+		}
+		uint64_t won = 0, fell = 0;
+		double winMoves = 0;
+		for (int m=0; m<=maxMoves; m++)
+		{
+			won += sum.winsAt[m];
+			winMoves += (double)m * sum.winsAt[m];
+		}
+		for (int d=0; d<=table.offGrid; d++)
+			fell += sum.deaths[d];
+
+		printf("%s: optimal %d, %lld games, won %.2f%% (mean %.1f moves), fell %.2f%%, timed out %.2f%%\n",
+			name.c_str(), graph.optimal, games, 100.0*won/games, won ? winMoves/won : 0.0,
+			100.0*fell/games, 100.0*sum.timeouts/games);
+		if (graph.optimal > 0)
+		{
+			printf("  won within");
+			for (int k=graph.optimal; ; k*=2)
+			{
+				k = std::min(k, maxMoves);
+				uint64_t within = 0;
+				for (int m=0; m<=k; m++)
+					within += sum.winsAt[m];
+				printf(" %d: %.2f%%", k, 100.0*within/games);
+				if (k == maxMoves)
+					break;
+			}
+			printf("\n");
+		}
+		std::vector<int> order;
+		for (int d=0; d<=table.offGrid; d++)
+			if (sum.deaths[d])
+				order.push_back(d);
+		std::sort(order.begin(), order.end(), [&](int a, int b) { return sum.deaths[a] > sum.deaths[b]; });
+		if (!order.empty())
+		{
+			printf("  falls at");
+			for (size_t i=0; i<order.size() && i<ROLLOUT_DEATHS; i++)
+			{
+				int d = order[i];
+				if (d == table.offGrid)
+					printf(" edge");
+				else
+					printf(" %d,%d %s", d / level.width + 1, d % level.width + 1, tileKinds[level.cells[d]].name);
+				printf(" %.1f%%", 100.0*sum.deaths[d]/fell);
+			}
+			printf("\n");
+		}
+		printf("  %.2f M games/s, %.1f M moves/s\n", games/seconds/1e6, sum.moves/seconds/1e6);
+		totalGames += games;
+		totalMoves += sum.moves;
+		totalSeconds += seconds;
+	}
+	fprintf(stderr, "%llu games, %llu moves in %.2f s on %d threads: %.2f M games/s, %.1f M moves/s\n",
+		(unsigned long long)totalGames, (unsigned long long)totalMoves, totalSeconds, threads,
+		totalGames/totalSeconds/1e6, totalMoves/totalSeconds/1e6);
+	return 0;
+}
@@ -0,0 +1,110 @@
+#include <vector>
+
+#include "mesh.h"
+
+GpuStats gpuStats;
+
+/* Every VAO created and not yet deleted */
+static std::vector<VAO*> meshes;
+
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode)
+{
+	struct VAO* vao = new struct VAO;
+	vao->PrimitiveMode = primitive_mode;
+	vao->NumVertices = numVertices;
+	vao->FillMode = fill_mode;
+	GLsizeiptr size = 3*numVertices*sizeof(GLfloat);
+
+    // Create Vertex Array Object
+    // Should be done after CreateWindow and before any other GL calls
+    glGenVertexArrays(1, &(vao->VertexArrayID)); // VAO
+    glGenBuffers (1, &(vao->VertexBuffer)); // VBO - vertices
+    glGenBuffers (1, &(vao->ColorBuffer));  // VBO - colors
+
+    glBindVertexArray (vao->VertexArrayID); // Bind the VAO
+    glBindBuffer (GL_ARRAY_BUFFER, vao->VertexBuffer); // Bind the VBO vertices
+    glBufferData (GL_ARRAY_BUFFER, size, vertex_buffer_data, GL_STATIC_DRAW); // Copy the vertices into VBO
+    glVertexAttribPointer(
+                          0,                  // attribute 0. Vertices
+                          3,                  // size (x,y,z)
+                          GL_FLOAT,           // type
+                          GL_FALSE,           // normalized?
+                          0,                  // stride
+                          (void*)0            // array buffer offset
+                          );
+
+    glBindBuffer (GL_ARRAY_BUFFER, vao->ColorBuffer); // Bind the VBO colors
+    glBufferData (GL_ARRAY_BUFFER, size, color_buffer_data, GL_STATIC_DRAW);  // Copy the vertex colors
+    glVertexAttribPointer(
+                          1,                  // attribute 1. Color
+                          3,                  // size (r,g,b)
+                          GL_FLOAT,           // type
+                          GL_FALSE,           // normalized?
+                          0,                  // stride
+                          (void*)0            // array buffer offset
+                          );
+
+	gpuStats.vaos++;
+	gpuStats.buffers += 2;
+	gpuStats.bytes += 2*size;
+	meshes.push_back(vao);
+	return vao;
+}
+
+static void deleteMesh (struct VAO* vao)
+{
+	glDeleteBuffers(1, &(vao->VertexBuffer));
+	glDeleteBuffers(1, &(vao->ColorBuffer));
+	glDeleteVertexArrays(1, &(vao->VertexArrayID));
+	gpuStats.vaos--;
+	gpuStats.buffers -= 2;
+	gpuStats.bytes -= 2*3*vao->NumVertices*sizeof(GLfloat);
+	delete vao;
+}
+
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode)
+{
+	// Only needed until the upload, so it is freed on the way out
+	std::vector<GLfloat> color_buffer_data(3*numVertices);
+	for (int i=0; i<numVertices; i++) {
+		color_buffer_data [3*i] = red;
+		color_buffer_data [3*i + 1] = green;
+		color_buffer_data [3*i + 2] = blue;
+	}
+
+	return create3DObject(primitive_mode, numVertices, vertex_buffer_data, &color_buffer_data[0], fill_mode);
+}
+
+void draw3DObject (struct VAO* vao)
+{
+    // Change the Fill Mode for this object
+	glPolygonMode (GL_FRONT_AND_BACK, vao->FillMode);
+
+    // Bind the VAO to use
+	glBindVertexArray (vao->VertexArrayID);
+
+    // Enable Vertex Attribute 0 - 3d Vertices
+	glEnableVertexAttribArray(0);
+    // Bind the VBO to use
+	glBindBuffer(GL_ARRAY_BUFFER, vao->VertexBuffer);
+
+    // Enable Vertex Attribute 1 - Color
+	glEnableVertexAttribArray(1);
+    // Bind the VBO to use
+	glBindBuffer(GL_ARRAY_BUFFER, vao->ColorBuffer);
+
+    // Draw the geometry !
+    glDrawArrays(vao->PrimitiveMode, 0, vao->NumVertices); // Starting from vertex 0; 3 vertices total -> 1 triangle
+}
+
+void destroyMeshes ()
+{
+	for (size_t i=0; i<meshes.size(); i++)
+		deleteMesh(meshes[i]);
+	meshes.clear();
+}
+
+void printGpuStats (FILE *out)
+{
+	fprintf(out, "gpu: vaos=%d buffers=%d bytes=%ld\n", gpuStats.vaos, gpuStats.buffers, gpuStats.bytes);
+}
@@ -0,0 +1,39 @@
+#ifndef MESH_H
+#define MESH_H
+
+#include <cstdio>
+
+#include <GL/glew.h>
+#include <GL/gl.h>
+
+struct VAO {
+	GLuint VertexArrayID;
+	GLuint VertexBuffer;
+	GLuint ColorBuffer;
+
+	GLenum PrimitiveMode;
+	GLenum FillMode;
+	int NumVertices;
+};
+typedef struct VAO VAO;
+
+/* Live GL object counters, to check nothing leaks */
+struct GpuStats {
+	int vaos;
+	int buffers;
+	long bytes;
+};
+extern GpuStats gpuStats;
+
+/* Generate VAO, VBOs and return VAO handle */
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat* color_buffer_data, GLenum fill_mode=GL_FILL);
+/* Generate VAO, VBOs and return VAO handle - Common Color for all vertices */
+struct VAO* create3DObject (GLenum primitive_mode, int numVertices, const GLfloat* vertex_buffer_data, const GLfloat red, const GLfloat green, const GLfloat blue, GLenum fill_mode=GL_FILL);
+/* Render the VBOs handled by VAO */
+void draw3DObject (struct VAO* vao);
+
+/* Delete every mesh created. Call before the context goes away. */
+void destroyMeshes ();
+void printGpuStats (FILE *out);
+
+#endif
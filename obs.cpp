@@ -0,0 +1,118 @@
+#include <cstring>
+
+#include "obs.h"
+
+/* Static channel of each tile mesh, -1 for none. Bridges are dynamic and
+ * handled by setBridges(). */
+static const int meshChannel[MESH_COUNT] = {
+	-1,				// MESH_NONE
+	OBS_SOLID,
+	OBS_FRAGILE,
+	OBS_SWITCH,
+	-1,				// MESH_BRIDGE
+	OBS_GOAL,
+	OBS_SOLID		// MESH_SPLIT: holds the block like solid floor
+};
+
+ObsEncoder::ObsEncoder() : rows(0), cols(0), plane(0), count(0), lastBuf(NULL)
+{
+}
+
+void ObsEncoder::init(const EnvBatch &env)
+{
+	rows = cols = 0;
+	for (int l=0; l<env.levelCount(); l++)
+	{
+		const Level &level = env.levelAt(l);
+		if (level.height > rows)
+			rows = level.height;
+		if (level.width > cols)
+			cols = level.width;
+	}
+	plane = ((size_t)rows*cols + OBS_ALIGN-1) & ~(size_t)(OBS_ALIGN-1);
+	count = env.size();
+	invalidate();
+}
+
+void ObsEncoder::invalidate()
+{
+	lastBuf = NULL;
+	lastState.assign(count, -1);
+	lastLevel.assign(count, 0);
+}
+
+/* Set or clear the OBS_BRIDGE cells of the bridge groups in groups, going
+ * by mask. Taken from the bindings rather than level.tiles, which leaves
+ * out the bridges the block never rests on. */
+void ObsEncoder::setBridges(const Level &level, uint32_t groups, uint32_t mask, uint8_t *out)
+{
+	uint8_t *bridges = out + OBS_BRIDGE*plane;
+	for (size_t b=0; b<level.bridges.size(); b++)
+	{
+		const BridgeLink &link = level.bridges[b];
+		if (!(groups >> link.group & 1) || tileKinds[level.cells[link.cell]].support != SUPPORT_EXTENDED)
+			continue;
+		bridges[link.cell / level.width * cols + link.cell % level.width] = mask >> link.group & 1;
+	}
+}
+
+void ObsEncoder::setBlock(const Level &level, int pose, uint8_t value, uint8_t *out)
+{
+	uint8_t *block = out + OBS_BLOCK*plane;
+	int r[2], c[2];
+	int n = level.poseCells(pose, r, c);
+	for (int k=0; k<n; k++)
+		if (level.inside(r[k], c[k]))
+			block[r[k]*cols + c[k]] = value;
+}
+
+/* All channels except the block */
+void ObsEncoder::encodeBoard(const Level &level, uint32_t mask, uint8_t *out)
+{
+	memset(out, 0, envBytes());
+	for (int i=0; i<level.height; i++)
+		for (int j=0; j<level.width; j++)
+		{
+			int channel = meshChannel[tileKinds[level.cells[i*level.width + j]].mesh];
+			if (channel >= 0)
+				out[channel*plane + i*cols + j] = 1;
+		}
+	setBridges(level, ~0u, mask, out);
+}
+
+bool ObsEncoder::encode(const EnvBatch &env, uint8_t *buf)
+{
+	if ((uintptr_t)buf & (OBS_ALIGN-1))
+		return false;
+	if (buf != lastBuf)
+	{
+		invalidate();
+		lastBuf = buf;
+	}
+	const int32_t *states = env.states();
+	const uint16_t *levels = env.levels();
+	for (int i=0; i<count; i++)
+	{
+		int32_t state = states[i];
+		if (state == lastState[i] && levels[i] == lastLevel[i])
+			continue;
+		const Level &level = env.levelAt(levels[i]);
+		int32_t base = env.levelBase(levels[i]);
+		StateKey key = state - base;
+		uint8_t *out = buf + i*envBytes();
+		if (lastState[i] < 0 || levels[i] != lastLevel[i])
+			encodeBoard(level, stateMask(level, key), out);
+		else
+		{
+			StateKey old = lastState[i] - base;
+			setBlock(level, statePose(level, old), 0, out);
+			uint32_t flipped = stateMask(level, old) ^ stateMask(level, key);
+			if (flipped)
+				setBridges(level, flipped, stateMask(level, key), out);
+		}
+		setBlock(level, statePose(level, key), 1, out);
+		lastState[i] = state;
+		lastLevel[i] = levels[i];
+	}
+	return true;
+}
@@ -0,0 +1,66 @@
+#ifndef OBS_H
+#define OBS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#include "env.h"
+
+/* Board observations for learners, written straight into a buffer the
+ * caller owns (and may share or map), as uint8 bitplanes:
+ *
+ *   buf[env][channel][row][col]
+ *
+ * Every plane is height x width (the largest level of the batch, smaller
+ * boards sit top-left, padded with zeros) rounded up to OBS_ALIGN bytes,
+ * and the buffer itself must be OBS_ALIGN-aligned, so every plane starts on
+ * a cache line. Cells are 1 where the channel applies and 0 elsewhere. */
+
+#define OBS_ALIGN 64
+
+enum ObsChannel {
+	OBS_SOLID,
+	OBS_FRAGILE,
+	OBS_SWITCH,		// soft and hard switches
+	OBS_BRIDGE,		// bridges of extended groups only
+	OBS_GOAL,
+	OBS_BLOCK,		// cells under the block
+	OBS_CHANNELS
+};
+
+class ObsEncoder {
+public:
+	ObsEncoder();
+	/* Work out the layout for env's levels */
+	void init(const EnvBatch &env);
+	int height() const { return rows; }
+	int width() const { return cols; }
+	size_t planeBytes() const { return plane; }
+	size_t envBytes() const { return plane*OBS_CHANNELS; }
+	size_t bytes() const { return envBytes()*count; }
+
+	/* Bring buf up to date with env. Only what changed since the last
+	 * encode into the same buffer is rewritten: the block footprint after
+	 * a move, bridges of the groups a switch flipped, and the whole board
+	 * after a reset onto another level. Returns false if buf isn't
+	 * OBS_ALIGN-aligned. */
+	bool encode(const EnvBatch &env, uint8_t *buf);
+	/* Make the next encode write everything, e.g. after the caller
+	 * cleared or reused the buffer */
+	void invalidate();
+
+private:
+	void encodeBoard(const Level &level, uint32_t mask, uint8_t *out);
+	void setBridges(const Level &level, uint32_t groups, uint32_t mask, uint8_t *out);
+	void setBlock(const Level &level, int pose, uint8_t value, uint8_t *out);
+
+	int rows, cols;
+	size_t plane;
+	int count;
+	const uint8_t *lastBuf;
+	std::vector<int32_t> lastState;		// global state last encoded, -1 for none
+	std::vector<uint16_t> lastLevel;
+};
+
+#endif
@@ -0,0 +1,401 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pack.h"
+
+static_assert(sizeof(PackHeader) == 16, "PackHeader layout");
+static_assert(sizeof(PackIndex) == 16, "PackIndex layout");
+static_assert(sizeof(PackLevel) == 16, "PackLevel layout");
+static_assert(sizeof(PackBindings) == 16, "PackBindings layout");
+static_assert(sizeof(PackLink) == 8, "PackLink layout");
+static_assert(sizeof(PackSplit) == 12, "PackSplit layout");
+
+static size_t align8(size_t n)
+{
+	return (n + 7) & ~(size_t)7;
+}
+
+int PackLevelView::tileAt(int row, int col) const
+{
+	if ((unsigned)row >= info->height || (unsigned)col >= info->width)
+		return TILE_EMPTY;
+	size_t cell = (size_t)row*info->width + col;
+	size_t plane = packPlaneBytes(info->width, info->height);
+	for (int p=0; p<info->planes; p++)
+		if (planes[p*plane + cell/8] & (1 << (cell%8)))
+			return TILE_SOLID + p;
+	return TILE_EMPTY;
+}
+
+LevelPack::LevelPack() : map(NULL), size(0), header(NULL), index(NULL)
+{
+}
+
+LevelPack::~LevelPack()
+{
+	close();
+}
+
+void LevelPack::close()
+{
+	if (map)
+		munmap(map, size);
+	map = NULL;
+	size = 0;
+	header = NULL;
+	index = NULL;
+}
+
+bool LevelPack::open(const char *path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Could not open pack %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(PackHeader))
+	{
+		fprintf(stderr, "%s: not a level pack\n", path);
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+		map = NULL;
+		fprintf(stderr, "%s: mmap failed\n", path);
+		return false;
+	}
+	header = (const PackHeader*)map;
+	index = (const PackIndex*)(header + 1);
+	this->path = path;
+	if (header->magic != PACK_MAGIC || header->version < 1 || header->version > PACK_VERSION
+		|| sizeof(PackHeader) + (size_t)header->count*sizeof(PackIndex) > size)
+	{
+		fprintf(stderr, "%s: bad pack header\n", path);
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool LevelPack::view(int i, PackLevelView &v) const
+{
+	if (i < 0 || i >= count())
+		return false;
+	const PackIndex &e = index[i];
+	// Every writer aligns records to 8 bytes; the view reads them in place
+	if (e.offset > size || e.bytes > size - e.offset || e.offset % 8 || e.bytes < sizeof(PackLevel))
+		return false;
+	const uint8_t *base = (const uint8_t*)map + e.offset;
+	v.info = (const PackLevel*)base;
+	v.planes = base + sizeof(PackLevel);
+	v.optimal = e.optimal;
+	v.bindings = NULL;
+	v.links = NULL;
+	v.splits = NULL;
+	if (v.info->planes > PACK_PLANES)
+		return false;
+	size_t bytes = sizeof(PackLevel) + v.info->planes*packPlaneBytes(v.info->width, v.info->height);
+	if (bytes > e.bytes)
+		return false;
+	if (header->version >= 2)
+	{
+		bytes = align8(bytes);
+		if (bytes + sizeof(PackBindings) > e.bytes)
+			return false;
+		v.bindings = (const PackBindings*)(base + bytes);
+		v.links = (const PackLink*)(v.bindings + 1);
+		bytes += sizeof(PackBindings) + ((size_t)v.bindings->switches + v.bindings->bridges)*sizeof(PackLink);
+		if (bytes > e.bytes)
+			return false;
+		if (header->version >= 3)
+		{
+			v.splits = (const PackSplit*)(v.links + v.bindings->switches + v.bindings->bridges);
+			if (bytes + (size_t)v.bindings->splits*sizeof(PackSplit) > e.bytes)
+				return false;
+		}
+	}
+	return true;
+}
+
+bool LevelPack::record(int i, const uint8_t **data, uint32_t *bytes) const
+{
+	if (i < 0 || i >= count() || index[i].offset + index[i].bytes > size)
+		return false;
+	*data = (const uint8_t*)map + index[i].offset;
+	*bytes = index[i].bytes;
+	return true;
+}
+
+bool LevelPack::decode(int i, Level &level) const
+{
+	PackLevelView v;
+	if (!view(i, v))
+		return false;
+	std::string name = path + ": level " + std::to_string(i);
+	// Checked before the board is allocated for it
+	if (!v.info->width || !v.info->height || v.info->width > LEVEL_MAX_SIZE || v.info->height > LEVEL_MAX_SIZE)
+	{
+		fprintf(stderr, "%s: bad level size\n", name.c_str());
+		return false;
+	}
+	level.resize(v.info->width, v.info->height);
+	level.originX = v.info->originX;
+	level.originY = v.info->originY;
+	level.startRow = v.info->startRow;
+	level.startCol = v.info->startCol;
+	size_t cells = level.cells.size();
+	size_t plane = packPlaneBytes(level.width, level.height);
+	for (int p=0; p<v.info->planes; p++)
+	{
+		const uint8_t *bits = v.planes + p*plane;
+		for (size_t byte=0; byte<plane; byte++)
+		{
+			if (!bits[byte])
+				continue;
+			for (int b=0; b<8 && byte*8 + b < cells; b++)
+				if (bits[byte] & (1 << b))
+					level.cells[byte*8 + b] = TILE_SOLID + p;
+		}
+	}
+	level.switches.clear();
+	level.bridges.clear();
+	level.splits.clear();
+	level.startMask = 1;
+	if (v.bindings)
+	{
+		level.startMask = v.bindings->startMask;
+		const PackLink *link = v.links;
+		for (int i=0; i<v.bindings->switches; i++, link++)
+			if (link->cell < cells)
+				level.switches.push_back(SwitchLink{(int)link->cell, link->value});
+		for (uint32_t i=0; i<v.bindings->bridges; i++, link++)
+			if (link->cell < cells && link->value < LEVEL_MAX_GROUPS)
+				level.bridges.push_back(BridgeLink{(int)link->cell, (int)link->value});
+		for (uint32_t i=0; v.splits && i<v.bindings->splits; i++)
+		{
+			const PackSplit &s = v.splits[i];
+			// finishBindings drops links that don't fit the board
+			level.splits.push_back(SplitLink{(int)s.cell, {(int)s.cubes[0], (int)s.cubes[1]}});
+		}
+	}
+	finishBindings(level);
+	return checkLevel(level, name.c_str());
+}
+
+/* Bytes of l's record in the current format */
+static uint32_t recordBytes(const Level &l)
+{
+	return align8(sizeof(PackLevel) + PACK_PLANES*packPlaneBytes(l.width, l.height))
+		+ sizeof(PackBindings) + (l.switches.size() + l.bridges.size())*sizeof(PackLink) + l.splits.size()*sizeof(PackSplit);
+}
+
+static const uint8_t zeros[8] = {0};
+
+static void writeRecord(FILE *file, const Level &l)
+{
+	PackLevel info;
+	info.width = l.width;
+	info.height = l.height;
+	info.startRow = l.startRow;
+	info.startCol = l.startCol;
+	info.originX = l.originX;
+	info.originY = l.originY;
+	info.planes = PACK_PLANES;
+	info.reserved = 0;
+	fwrite(&info, sizeof(info), 1, file);
+
+	size_t plane = packPlaneBytes(l.width, l.height);
+	std::vector<uint8_t> planes(PACK_PLANES*plane, 0);
+	for (size_t c=0; c<l.cells.size(); c++)
+		if (l.cells[c] != TILE_EMPTY)
+			planes[(l.cells[c] - TILE_SOLID)*plane + c/8] |= 1 << (c%8);
+	fwrite(&planes[0], 1, planes.size(), file);
+	size_t written = sizeof(PackLevel) + planes.size();
+	fwrite(zeros, 1, align8(written) - written, file);
+
+	PackBindings bindings;
+	bindings.startMask = l.startMask;
+	bindings.groups = l.groups;
+	bindings.switches = l.switches.size();
+	bindings.bridges = l.bridges.size();
+	bindings.splits = l.splits.size();
+	fwrite(&bindings, sizeof(bindings), 1, file);
+	for (size_t n=0; n<l.switches.size(); n++)
+	{
+		PackLink link = { (uint32_t)l.switches[n].cell, l.switches[n].toggles };
+		fwrite(&link, sizeof(link), 1, file);
+	}
+	for (size_t n=0; n<l.bridges.size(); n++)
+	{
+		PackLink link = { (uint32_t)l.bridges[n].cell, (uint32_t)l.bridges[n].group };
+		fwrite(&link, sizeof(link), 1, file);
+	}
+	for (size_t n=0; n<l.splits.size(); n++)
+	{
+		PackSplit split = { (uint32_t)l.splits[n].cell, { (uint32_t)l.splits[n].cubes[0], (uint32_t)l.splits[n].cubes[1] } };
+		fwrite(&split, sizeof(split), 1, file);
+	}
+}
+
+static FILE *createPack(const char *path, const std::vector<PackIndex> &index)
+{
+	FILE *file = fopen(path, "wb");
+	if (!file)
+	{
+		fprintf(stderr, "Could not create %s\n", path);
+		return NULL;
+	}
+	PackHeader header;
+	header.magic = PACK_MAGIC;
+	header.version = PACK_VERSION;
+	header.count = index.size();
+	header.reserved = 0;
+	fwrite(&header, sizeof(header), 1, file);
+	if (!index.empty())
+		fwrite(&index[0], sizeof(PackIndex), index.size(), file);
+	return file;
+}
+
+static bool finishPack(FILE *file, const char *path)
+{
+	bool ok = !ferror(file);
+	if (fclose(file) != 0)
+		ok = false;
+	if (!ok)
+		fprintf(stderr, "Failed writing %s\n", path);
+	return ok;
+}
+
+bool writePack(const char *path, const std::vector<Level> &levels, const std::vector<int> &optimal)
+{
+	std::vector<PackIndex> index(levels.size());
+	size_t offset = sizeof(PackHeader) + index.size()*sizeof(PackIndex);
+	for (size_t i=0; i<levels.size(); i++)
+	{
+		offset = align8(offset);
+		index[i].offset = offset;
+		index[i].bytes = recordBytes(levels[i]);
+		index[i].optimal = i < optimal.size() ? optimal[i] : PACK_NOT_SOLVED;
+		offset += index[i].bytes;
+	}
+	FILE *file = createPack(path, index);
+	if (!file)
+		return false;
+
+	size_t pos = sizeof(PackHeader) + index.size()*sizeof(PackIndex);
+	for (size_t i=0; i<levels.size(); i++)
+	{
+		fwrite(zeros, 1, index[i].offset - pos, file);
+		writeRecord(file, levels[i]);
+		pos = index[i].offset + index[i].bytes;
+	}
+	return finishPack(file, path);
+}
+
+bool writePackSubset(const char *path, const LevelPack &from, const std::vector<int> &keep)
+{
+	// Current-format records are copied as they are; older ones are converted
+	bool copy = from.version() == PACK_VERSION;
+	std::vector<PackIndex> index(keep.size());
+	size_t offset = sizeof(PackHeader) + index.size()*sizeof(PackIndex);
+	Level level;
+	for (size_t i=0; i<keep.size(); i++)
+	{
+		PackLevelView v;
+		const uint8_t *data;
+		uint32_t bytes;
+		if (!from.view(keep[i], v) || !from.record(keep[i], &data, &bytes) || (!copy && !from.decode(keep[i], level)))
+		{
+			fprintf(stderr, "%s: level %d is corrupt\n", path, keep[i]);
+			return false;
+		}
+		offset = align8(offset);
+		index[i].offset = offset;
+		index[i].bytes = copy ? bytes : recordBytes(level);
+		index[i].optimal = v.optimal;
+		offset += index[i].bytes;
+	}
+	FILE *file = createPack(path, index);
+	if (!file)
+		return false;
+
+	size_t pos = sizeof(PackHeader) + index.size()*sizeof(PackIndex);
+	for (size_t i=0; i<keep.size(); i++)
+	{
+		fwrite(zeros, 1, index[i].offset - pos, file);
+		const uint8_t *data;
+		uint32_t bytes;
+		if (copy && from.record(keep[i], &data, &bytes))
+			fwrite(data, 1, bytes, file);
+		else if (from.decode(keep[i], level))
+			writeRecord(file, level);
+		else
+		{
+			// The index is already written; don't leave it pointing at nothing
+			fprintf(stderr, "%s: level %d is corrupt\n", path, keep[i]);
+			fclose(file);
+			remove(path);
+			return false;
+		}
+		pos = index[i].offset + index[i].bytes;
+	}
+	return finishPack(file, path);
+}
+
+bool isPackEntry(const std::string &file, std::string *pack, int *index)
+{
+	size_t colon = file.rfind(':');
+	if (colon == std::string::npos || colon < 5 || file.compare(colon - 5, 5, ".pack") != 0)
+		return false;
+	char *end;
+	long n = strtol(file.c_str() + colon + 1, &end, 10);
+	if (*end || n < 0)
+		return false;
+	*pack = file.substr(0, colon);
+	*index = (int)n;
+	return true;
+}
+
+bool loadPackLevel(const std::string &pack, int index, Level &level)
+{
+	// Packs stay mapped for the life of the process
+	static std::mutex lock;
+	static std::map<std::string, LevelPack*> packs;
+	LevelPack *p;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		p = packs[pack];
+		if (!p)
+		{
+			p = new LevelPack;
+			if (!p->open(pack.c_str()))
+			{
+				delete p;
+				packs.erase(pack);
+				return false;
+			}
+			packs[pack] = p;
+		}
+	}
+	if (!p->decode(index, level))
+	{
+		fprintf(stderr, "%s: no level %d\n", pack.c_str(), index);
+		return false;
+	}
+	return true;
+}
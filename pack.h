@@ -0,0 +1,132 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "level.h"
+
+/* Binary level pack, read with mmap so picking a level is a pointer lookup.
+ *
+ *   PackHeader
+ *   PackIndex[count]          one per level, in pack order
+ *   level records             each 8-byte aligned, at PackIndex::offset:
+ *     PackLevel
+ *     bitplanes               one per tile type from TILE_SOLID, each
+ *                             (width*height+7)/8 bytes, bit i = cell i row-major
+ *     padding to 8 bytes
+ *     PackBindings            version 2 and up
+ *     PackLink[switches]      cell, groups toggled
+ *     PackLink[bridges]       cell, group
+ *     PackSplit[splits]       version 3 and up
+ *
+ * All integers are little-endian. Version 1 packs (five planes, one
+ * shared bridge set) and version 2 packs (no split tiles) still load. */
+
+#define PACK_MAGIC 0x50584c42	// "BLXP"
+#define PACK_VERSION 3
+#define PACK_PLANES (TILE_KINDS-1)	// TILE_SOLID .. last tile type
+
+/* PackIndex::optimal when no solution length was stored */
+#define PACK_NOT_SOLVED -2
+/* PackIndex::optimal when the solver found no solution */
+#define PACK_UNSOLVABLE -1
+
+struct PackHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t reserved;
+};
+
+struct PackIndex {
+	uint64_t offset;
+	uint32_t bytes;
+	int32_t optimal;
+};
+
+struct PackLevel {
+	uint16_t width, height;
+	uint16_t startRow, startCol;
+	int16_t originX, originY;
+	uint16_t planes;
+	uint16_t reserved;
+};
+
+struct PackBindings {
+	uint32_t startMask;
+	uint16_t groups;
+	uint16_t switches;
+	uint32_t bridges;
+	uint32_t splits;	// reserved, zero, before version 3
+};
+
+struct PackLink {
+	uint32_t cell;
+	uint32_t value;
+};
+
+/* A split tile and the cells its two cubes go to */
+struct PackSplit {
+	uint32_t cell;
+	uint32_t cubes[2];
+};
+
+inline size_t packPlaneBytes(int width, int height)
+{
+	return ((size_t)width*height + 7) / 8;
+}
+
+/* Zero-copy view of one level inside a mapped pack */
+struct PackLevelView {
+	const PackLevel *info;
+	const uint8_t *planes;
+	const PackBindings *bindings;	// NULL in version 1 packs
+	const PackLink *links;			// switches then bridges
+	const PackSplit *splits;		// NULL before version 3
+	int optimal;
+
+	int tileAt(int row, int col) const;
+};
+
+class LevelPack {
+public:
+	LevelPack();
+	~LevelPack();
+	bool open(const char *path);
+	void close();
+	int count() const { return header ? (int)header->count : 0; }
+	/* O(1); the view points into the mapping and lives as long as the pack */
+	bool view(int index, PackLevelView &v) const;
+	/* Expand a packed level into a Level (parse step only, not compiled).
+	 * Fails, saying why, on a level parseLevel would reject. */
+	bool decode(int index, Level &level) const;
+	/* The level's record as stored, in this pack's version */
+	bool record(int index, const uint8_t **data, uint32_t *bytes) const;
+	int version() const { return header ? (int)header->version : 0; }
+private:
+	LevelPack(const LevelPack&);
+	LevelPack& operator=(const LevelPack&);
+
+	std::string path;
+	void *map;
+	size_t size;
+	const PackHeader *header;
+	const PackIndex *index;
+};
+
+/* Serialise levels into a pack. optimal may be empty, otherwise one entry
+ * per level (PACK_NOT_SOLVED / PACK_UNSOLVABLE / move count). */
+bool writePack(const char *path, const std::vector<Level> &levels, const std::vector<int> &optimal);
+
+/* Pack of the given levels of from, in that order, keeping their optimal
+ * counts; records are copied without decoding when from is current */
+bool writePackSubset(const char *path, const LevelPack &from, const std::vector<int> &keep);
+
+/* "file.pack:N" names level N of a pack in a manifest entry */
+bool isPackEntry(const std::string &file, std::string *pack, int *index);
+/* Load a pack level through a process-wide cache of open packs */
+bool loadPackLevel(const std::string &pack, int index, Level &level);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+/* splitmix64: one add and a few multiplies per number and cheap to seed,
+ * so tools give every work item its own stream from (seed, index) and get
+ * the same results on any number of threads */
+struct Rng {
+	uint64_t s;
+	explicit Rng(uint64_t seed) : s(seed) {}
+	Rng(uint64_t seed, uint64_t index) : s(seed * 0x9e3779b97f4a7c15ull ^ index * 0xd1b54a32d192ed03ull) {}
+	uint64_t next()
+	{
+		uint64_t z = (s += 0x9e3779b97f4a7c15ull);
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+	int below(int n) { return next() % n; }
+	bool chance(int percent) { return below(100) < percent; }
+};
+
+#endif
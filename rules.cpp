@@ -0,0 +1,108 @@
+#include <algorithm>
+
+#include "rules.h"
+
+/* supportHolds[SupportRule][standing][extended] */
+static const bool supportHolds[4][2][2] = {
+	{ {false, false}, {false, false} },	// SUPPORT_NONE
+	{ {true, true}, {true, true} },		// SUPPORT_ALWAYS
+	{ {true, true}, {false, false} },	// SUPPORT_LYING
+	{ {false, true}, {false, true} }	// SUPPORT_EXTENDED
+};
+
+/* One cell under the block: false if the block falls. Adds the groups a
+ * switch there flips to *toggle. */
+static bool checkCell(const Level &level, int row, int col, uint32_t mask, bool standing, uint32_t *toggle)
+{
+	const TileKind &kind = tileKinds[level.at(row, col)];
+	bool extended = kind.support == SUPPORT_EXTENDED && (mask >> level.bridgeGroup(row, col) & 1);
+	if (!supportHolds[kind.support][standing][extended])
+		return false;
+	if (kind.trigger == TRIGGER_SWITCH || (kind.trigger == TRIGGER_HARD_SWITCH && standing))
+		*toggle |= level.switchToggles(row, col);
+	return true;
+}
+
+int restBlock(const Level &level, int row, int col, int orientation, uint32_t mask, uint32_t *toggle)
+{
+	*toggle = 0;
+	if (orientation == 0)
+	{
+		if (!checkCell(level, row, col, mask, true, toggle))
+			return REST_FALL;
+		int trigger = tileKinds[level.at(row, col)].trigger;
+		if (trigger == TRIGGER_SPLIT && level.splitAt(row*level.width + col))
+			return REST_SPLIT;
+		return trigger == TRIGGER_GOAL ? REST_WIN : REST_OK;
+	}
+	int row2 = row - (orientation == 2), col2 = col - (orientation == 1);
+	bool a = checkCell(level, row, col, mask, false, toggle);
+	bool b = checkCell(level, row2, col2, mask, false, toggle);
+	return a && b ? REST_OK : REST_FALL;
+}
+
+int restCube(const Level &level, int row, int col, uint32_t mask, uint32_t *toggle)
+{
+	*toggle = 0;
+	return checkCell(level, row, col, mask, false, toggle) ? REST_OK : REST_FALL;
+}
+
+int joinCubes(const Level &level, int row, int col, int row2, int col2)
+{
+	// Lying along x covers col and col-1, along y row and row-1
+	if (row == row2 && (col - col2 == 1 || col2 - col == 1))
+		return level.poseIndex(row, std::max(col, col2), 1);
+	if (col == col2 && (row - row2 == 1 || row2 - row == 1))
+		return level.poseIndex(std::max(row, row2), col, 2);
+	return -1;
+}
+
+/* Two cubes at rest, the one on cell moving next: joined if they touch */
+static int cubePose(const Level &level, int cell, int other)
+{
+	int pose = joinCubes(level, cell / level.width, cell % level.width, other / level.width, other % level.width);
+	return pose >= 0 ? pose : level.splitPose(cell, other);
+}
+
+int stepState(const Level &level, StateKey key, int dir, StateKey *to)
+{
+	int pose = statePose(level, key);
+	int next = level.next[(size_t)pose*4 + dir];
+	if (next < 0)
+		return REST_FALL;
+	int rows[2], cols[2];
+	level.poseCells(next, rows, cols);
+	uint32_t mask = stateMask(level, key), toggle;
+	if (level.isSplitPose(next))
+	{
+		// Only the cube that rolled has anything new under it
+		if (restCube(level, rows[0], cols[0], mask, &toggle) != REST_OK)
+			return REST_FALL;
+		*to = stateKey(level, cubePose(level, rows[0]*level.width + cols[0], rows[1]*level.width + cols[1]), mask ^ toggle);
+		return REST_OK;
+	}
+	int result = restBlock(level, rows[0], cols[0], next % 3, mask, &toggle);
+	if (result == REST_SPLIT)
+	{
+		const SplitLink *s = level.splitAt(rows[0]*level.width + cols[0]);
+		uint32_t toggles[2];
+		for (int c=0; c<2; c++)
+			if (restCube(level, s->cubes[c] / level.width, s->cubes[c] % level.width, mask, &toggles[c]) != REST_OK)
+				return REST_FALL;
+		*to = stateKey(level, cubePose(level, s->cubes[0], s->cubes[1]), mask ^ (toggles[0] | toggles[1]));
+		return REST_OK;
+	}
+	if (result != REST_OK)
+		return result;
+	*to = stateKey(level, next, mask ^ toggle);
+	return REST_OK;
+}
+
+StateKey swapState(const Level &level, StateKey key)
+{
+	int pose = statePose(level, key);
+	if (!level.isSplitPose(pose))
+		return key;
+	int floor = level.floorCells.size(), pair = pose - level.wholePoses();
+	return stateKey(level, level.wholePoses() + pair % floor * floor + pair / floor, stateMask(level, key));
+}
@@ -0,0 +1,66 @@
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "level.h"
+
+/* The game rules without any rendering, shared by the GL client, the
+ * solver and the tools. */
+
+enum RestResult {
+	REST_OK,
+	REST_FALL,
+	REST_WIN,
+	REST_SPLIT		// standing on a bound split tile; restBlock() only
+};
+
+/* What happens when the block comes to rest at (row, col, orientation)
+ * with bridge groups mask extended, going by the support and trigger
+ * columns of tileKinds. *toggle gets the groups the switches under the
+ * block flip; the caller applies it with mask ^= *toggle. On REST_SPLIT
+ * the caller puts the cubes on the tile's targets with restCube(). */
+int restBlock(const Level &level, int row, int col, int orientation, uint32_t mask, uint32_t *toggle);
+/* The same for one cube of a split block: REST_OK or REST_FALL. A cube
+ * weighs what a lying block does on each tile: fragile tiles hold it and
+ * hard switches and the goal ignore it. */
+int restCube(const Level &level, int row, int col, uint32_t mask, uint32_t *toggle);
+/* The whole pose two cubes next to each other join into, or -1 if they
+ * aren't side by side */
+int joinCubes(const Level &level, int row, int col, int row2, int col2);
+
+/* Solver state: a pose plus the switch mask, packed into one integer as
+ * pose << groups | mask, so each bridge group adds one bit and visited
+ * sets stay flat arrays. A split block has two states, one per cube that
+ * moves next; handing over to the other cube isn't a move, so searches
+ * reach both at the same depth (see swapState()). */
+typedef uint32_t StateKey;
+
+inline StateKey stateKey(const Level &level, int pose, uint32_t mask)
+{
+	return (StateKey)pose << level.groups | mask;
+}
+inline int statePose(const Level &level, StateKey key)
+{
+	return key >> level.groups;
+}
+inline uint32_t stateMask(const Level &level, StateKey key)
+{
+	return key & ((1u << level.groups) - 1);
+}
+inline int stateCount(const Level &level)
+{
+	return level.poseCount() << level.groups;
+}
+inline StateKey startState(const Level &level)
+{
+	return stateKey(level, level.poseIndex(level.startRow, level.startCol, 0), level.startMask);
+}
+
+/* One roll from key. Returns REST_OK with *to set, or REST_FALL / REST_WIN. */
+int stepState(const Level &level, StateKey key, int dir, StateKey *to);
+/* key with the other cube moving next; key itself for a whole block */
+StateKey swapState(const Level &level, StateKey key);
+
+#endif
@@ -0,0 +1,243 @@
+#include <cstdio>
+#include <cstring>
+#include <cstddef>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "runlog.h"
+
+static_assert(sizeof(RunLogHeader) == 64, "RunLogHeader layout");
+static_assert(sizeof(RunRecord) == 256, "RunRecord layout");
+
+/* Records added to the file at a time */
+#define RUNLOG_GROW 256
+
+uint32_t runChecksum(const RunRecord &r)
+{
+	// FNV-1a
+	const uint8_t *p = (const uint8_t*)&r;
+	uint32_t h = 2166136261u;
+	for (size_t i=0; i<offsetof(RunRecord, checksum); i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+static bool checkHeader(const RunLogHeader *h, const char *path)
+{
+	if (h->magic != RUNLOG_MAGIC || h->version < 1 || h->version > RUNLOG_VERSION || h->recordSize != sizeof(RunRecord))
+	{
+		fprintf(stderr, "%s: not a run log\n", path);
+		return false;
+	}
+	return true;
+}
+
+RunLog::RunLog() : fd(-1), map(NULL), size(0), next(0)
+{
+}
+
+RunLog::~RunLog()
+{
+	close();
+}
+
+void RunLog::close()
+{
+	if (map)
+		munmap(map, size);
+	if (fd >= 0)
+		::close(fd);	// drops the lock too
+	fd = -1;
+	map = NULL;
+	size = 0;
+	next = 0;
+}
+
+bool RunLog::open(const char *path)
+{
+	close();
+	fd = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Could not open run log %s\n", path);
+		return false;
+	}
+	if (flock(fd, LOCK_EX | LOCK_NB) < 0)
+	{
+		fprintf(stderr, "%s: in use by another game\n", path);
+		close();
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+	{
+		close();
+		return false;
+	}
+	bool fresh = st.st_size == 0;
+	if (!fresh && (size_t)st.st_size < sizeof(RunLogHeader))
+	{
+		fprintf(stderr, "%s: not a run log\n", path);
+		close();
+		return false;
+	}
+	// A torn grow can leave part of a record at the end; ignore it
+	size_t bytes = sizeof(RunLogHeader);
+	if (!fresh)
+		bytes += (st.st_size - sizeof(RunLogHeader)) / sizeof(RunRecord) * sizeof(RunRecord);
+	if (bytes == sizeof(RunLogHeader))
+		bytes += RUNLOG_GROW*sizeof(RunRecord);
+	if (!remap(bytes))
+		return false;
+	RunLogHeader *header = (RunLogHeader*)map;
+	// A zero header is a new file, possibly from a game that died creating it
+	if (fresh || header->magic == 0)
+	{
+		memset(header, 0, sizeof(*header));
+		header->magic = RUNLOG_MAGIC;
+		header->version = RUNLOG_VERSION;
+		header->recordSize = sizeof(RunRecord);
+	}
+	else if (!checkHeader(header, path))
+	{
+		close();
+		return false;
+	}
+	// Old records keep their layout, told apart by RUN_SWAPS
+	header->version = RUNLOG_VERSION;
+
+	// Append after the last committed record
+	const RunRecord *records = (const RunRecord*)(map + sizeof(RunLogHeader));
+	size_t slots = (size - sizeof(RunLogHeader)) / sizeof(RunRecord);
+	next = slots;
+	while (next > 0 && !runCommitted(records[next-1]))
+		next--;
+	return true;
+}
+
+/* Set the file to bytes long and map all of it */
+bool RunLog::remap(size_t bytes)
+{
+	if (ftruncate(fd, bytes) < 0)
+	{
+		perror("run log");
+		close();
+		return false;
+	}
+	if (map)
+		munmap(map, size);
+	map = (uint8_t*)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+	{
+		map = NULL;
+		perror("run log");
+		close();
+		return false;
+	}
+	size = bytes;
+	return true;
+}
+
+bool RunLog::append(uint32_t level, int outcome, uint64_t startTime, uint64_t duration, const std::vector<uint8_t> &moves)
+{
+	if (!map)
+		return false;
+	if (sizeof(RunLogHeader) + (next+1)*sizeof(RunRecord) > size && !remap(size + RUNLOG_GROW*sizeof(RunRecord)))
+		return false;
+	RunRecord *r = (RunRecord*)(map + sizeof(RunLogHeader)) + next;
+	memset(r, 0, sizeof(*r));
+	r->startTime = startTime;
+	r->duration = duration;
+	r->level = level;
+	r->outcome = outcome;
+	r->flags = RUN_SWAPS;
+	// Two swaps in a row hand back again, so only an odd count is kept
+	bool swapped = false;
+	for (size_t i=0; i<moves.size(); i++)
+	{
+		if (moves[i] == RUN_SWAP)
+		{
+			swapped = !swapped;
+			continue;
+		}
+		uint32_t m = r->logMoves;
+		if (m < RUNLOG_MAX_MOVES)
+		{
+			r->log[m/4] |= (moves[i] & 3) << (m%4*2);
+			r->log[RUNLOG_MAX_MOVES/4 + m/8] |= swapped << (m%8);
+			r->logMoves++;
+		}
+		else
+			r->flags |= RUN_TRUNCATED;
+		r->moves++;
+		swapped = false;
+	}
+	r->checksum = runChecksum(*r);
+	// The record has to be complete before the commit word says so
+	__atomic_store_n(&r->commit, RUNLOG_COMMIT, __ATOMIC_RELEASE);
+
+	// Start write-back now rather than at exit
+	size_t page = sysconf(_SC_PAGESIZE);
+	uintptr_t first = (uintptr_t)r & ~(page-1);
+	msync((void*)first, (uintptr_t)(r+1) - first, MS_ASYNC);
+	next++;
+	return true;
+}
+
+RunLogView::RunLogView() : map(NULL), size(0), records(NULL), slots(0)
+{
+}
+
+RunLogView::~RunLogView()
+{
+	close();
+}
+
+void RunLogView::close()
+{
+	if (map)
+		munmap(map, size);
+	map = NULL;
+	size = 0;
+	records = NULL;
+	slots = 0;
+}
+
+bool RunLogView::open(const char *path)
+{
+	close();
+	int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Could not open run log %s\n", path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RunLogHeader))
+	{
+		fprintf(stderr, "%s: not a run log\n", path);
+		::close(fd);
+		return false;
+	}
+	size = st.st_size;
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+	{
+		map = NULL;
+		fprintf(stderr, "%s: mmap failed\n", path);
+		return false;
+	}
+	if (!checkHeader((const RunLogHeader*)map, path))
+	{
+		close();
+		return false;
+	}
+	records = (const RunRecord*)((const uint8_t*)map + sizeof(RunLogHeader));
+	slots = (size - sizeof(RunLogHeader)) / sizeof(RunRecord);
+	return true;
+}
@@ -0,0 +1,119 @@
+#ifndef RUNLOG_H
+#define RUNLOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/* Persistent record of every level attempt, in an append-only file that is
+ * memory-mapped by both the writer and readers:
+ *
+ *   RunLogHeader
+ *   RunRecord[]     fixed size, in the order the runs finished
+ *
+ * A record counts only once its commit word holds RUNLOG_COMMIT and its
+ * checksum matches. The writer fills the record first and sets the commit
+ * word last, so a crash mid-append leaves a slot readers skip and the next
+ * writer reuses. Readers work on the mapping directly, no parsing. */
+
+#define RUNLOG_MAGIC 0x52584c42		// "BLXR"
+#define RUNLOG_VERSION 2		// version 1 logs are still read, and upgraded by the writer
+#define RUNLOG_COMMIT 0x434f4d54	// "TMOC"
+/* Moves kept per record: 2 bits each (DIR_*), then a bit each for a swap
+ * before it; longer runs are truncated. Version 1 records (without
+ * RUN_SWAPS) kept RUNLOG_LOG_BYTES*4 moves and no swaps. */
+#define RUNLOG_LOG_BYTES 216
+#define RUNLOG_MAX_MOVES (RUNLOG_LOG_BYTES*8/3)
+/* DIR_SWAP in the moves append() takes: the other cube of a split block
+ * takes over, which isn't a move */
+#define RUN_SWAP 4
+
+enum RunOutcome {
+	RUN_WON,
+	RUN_FELL,
+	RUN_QUIT		// the game was closed or the level restarted mid-level
+};
+
+/* RunRecord::flags */
+#define RUN_TRUNCATED 1		// more moves than RUNLOG_MAX_MOVES
+#define RUN_SWAPS 2			// log has the swap bits; every version 2 record
+
+struct RunLogHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t recordSize;
+	uint32_t reserved[13];
+};
+
+struct RunRecord {
+	uint64_t startTime;		// wall clock at level start, ns since the epoch
+	uint64_t duration;		// level start to the end of the run, ns
+	uint32_t level;			// manifest position, from 1
+	uint32_t moves;			// rolls; swaps aren't moves
+	uint16_t outcome;
+	uint16_t flags;
+	uint32_t logMoves;		// moves stored in log
+	uint8_t log[RUNLOG_LOG_BYTES];
+	uint32_t checksum;		// of everything above
+	uint32_t commit;		// RUNLOG_COMMIT once the record is complete
+};
+
+inline int runMove(const RunRecord &r, int i)
+{
+	return r.log[i/4] >> (i%4*2) & 3;
+}
+/* The other cube took over (an odd number of times) right before move i */
+inline bool runSwapBefore(const RunRecord &r, int i)
+{
+	return r.flags & RUN_SWAPS && r.log[RUNLOG_MAX_MOVES/4 + i/8] >> (i%8) & 1;
+}
+
+uint32_t runChecksum(const RunRecord &r);
+inline bool runCommitted(const RunRecord &r)
+{
+	return r.commit == RUNLOG_COMMIT && r.checksum == runChecksum(r);
+}
+
+/* The game's side: appends records. Takes an exclusive lock on the file,
+ * so a second game on the same log fails to open it instead of
+ * interleaving. */
+class RunLog {
+public:
+	RunLog();
+	~RunLog();
+	bool open(const char *path);
+	void close();
+	/* moves are DIR_* rolls and RUN_SWAP */
+	bool append(uint32_t level, int outcome, uint64_t startTime, uint64_t duration, const std::vector<uint8_t> &moves);
+private:
+	RunLog(const RunLog&);
+	RunLog& operator=(const RunLog&);
+	bool remap(size_t bytes);
+
+	int fd;
+	uint8_t *map;
+	size_t size;		// mapped bytes, always header + whole records
+	size_t next;		// slot the next record goes in
+};
+
+/* Read-only view for tools */
+class RunLogView {
+public:
+	RunLogView();
+	~RunLogView();
+	bool open(const char *path);
+	void close();
+	/* Slots in the file; check runCommitted() on each */
+	size_t count() const { return slots; }
+	const RunRecord &operator[](size_t i) const { return records[i]; }
+private:
+	RunLogView(const RunLogView&);
+	RunLogView& operator=(const RunLogView&);
+
+	void *map;
+	size_t size;
+	const RunRecord *records;
+	size_t slots;
+};
+
+#endif
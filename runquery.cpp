@@ -0,0 +1,130 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+#include "runlog.h"
+
+/* Statistics over a run log, read straight from the mapping.
+ *
+ *   runquery [-l level] [-d] [runs.dat]
+ *
+ * Prints, per level, how many runs were won and lost and the best, median,
+ * 90th and 99th percentile moves and times of the won runs. -d lists the
+ * runs themselves, with their moves as U D L R and S where the other cube
+ * of a split block took over, the way verifyd takes them. */
+
+struct LevelStats {
+	int runs, won, fell, quit;
+	std::vector<uint32_t> moves;
+	std::vector<uint64_t> times;
+	LevelStats() : runs(0), won(0), fell(0), quit(0) {}
+};
+
+/* Nearest-rank percentile of sorted values */
+template <class T>
+static T percentile(const std::vector<T> &sorted, int p)
+{
+	size_t rank = (sorted.size()*p + 99) / 100;
+	return sorted[rank ? rank-1 : 0];
+}
+
+static const char *outcomeName(int outcome)
+{
+	switch (outcome) {
+		case RUN_WON: return "won";
+		case RUN_FELL: return "fell";
+		case RUN_QUIT: return "quit";
+		default: return "?";
+	}
+}
+
+static void dump(const RunRecord &r)
+{
+	printf("level %u %s moves %u time %.3f ", r.level, outcomeName(r.outcome), r.moves, r.duration/1e9);
+	for (uint32_t i=0; i<r.logMoves; i++)
+	{
+		if (runSwapBefore(r, i))
+			putchar('S');
+		putchar("UDLR"[runMove(r, i)]);
+	}
+	if (r.flags & RUN_TRUNCATED)
+		printf("...");
+	putchar('\n');
+}
+
+int main(int argc, char **argv)
+{
+	const char *path = "runs.dat";
+	int only = 0;
+	bool list = false;
+	for (int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-l") && i+1 < argc)
+			only = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-d"))
+			list = true;
+		else if (argv[i][0] == '-')
+		{
+			fprintf(stderr, "usage: runquery [-l level] [-d] [runs.dat]\n");
+			return 2;
+		}
+		else
+			path = argv[i];
+	}
+
+	RunLogView log;
+	if (!log.open(path))
+		return 1;
+	std::map<uint32_t, LevelStats> levels;
+	size_t torn = 0;
+	for (size_t i=0; i<log.count(); i++)
+	{
+		const RunRecord &r = log[i];
+		if (r.commit == 0)
+			continue;	// free slot
+		if (!runCommitted(r))
+		{
+			torn++;
+			continue;
+		}
+		if (only && r.level != (uint32_t)only)
+			continue;
+		if (list)
+			dump(r);
+		LevelStats &s = levels[r.level];
+		s.runs++;
+		if (r.outcome == RUN_WON)
+		{
+			s.won++;
+			s.moves.push_back(r.moves);
+			s.times.push_back(r.duration);
+		}
+		else if (r.outcome == RUN_FELL)
+			s.fell++;
+		else
+			s.quit++;
+	}
+
+	printf("%-6s %6s %6s %6s %6s   %-23s   %s\n", "level", "runs", "won", "fell", "quit",
+		"moves best/p50/p90/p99", "seconds best/p50/p90/p99");
+	for (std::map<uint32_t, LevelStats>::iterator it = levels.begin(); it != levels.end(); ++it)
+	{
+		LevelStats &s = it->second;
+		printf("%-6u %6d %6d %6d %6d", it->first, s.runs, s.won, s.fell, s.quit);
+		if (s.won)
+		{
+			std::sort(s.moves.begin(), s.moves.end());
+			std::sort(s.times.begin(), s.times.end());
+			printf("   %5u %5u %5u %5u   %7.2f %7.2f %7.2f %7.2f",
+				s.moves[0], percentile(s.moves, 50), percentile(s.moves, 90), percentile(s.moves, 99),
+				s.times[0]/1e9, percentile(s.times, 50)/1e9, percentile(s.times, 90)/1e9, percentile(s.times, 99)/1e9);
+		}
+		printf("\n");
+	}
+	if (torn)
+		printf("%zu incomplete records skipped\n", torn);
+	return 0;
+}
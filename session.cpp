@@ -0,0 +1,331 @@
+#include <cstdio>
+#include <algorithm>
+
+#include "session.h"
+
+/* Command::dir values besides DIR_* */
+#define SESSION_OPEN 5
+#define SESSION_CLOSE 6
+/* Tick times kept per shard for the percentiles */
+#define SESSION_TICK_RING 8192
+
+typedef std::chrono::steady_clock Clock;
+
+static int idShard(SessionId id) { return id & 0xff; }
+static uint32_t idSlot(SessionId id) { return id >> 8 & 0xffffff; }
+static uint32_t idGeneration(SessionId id) { return id >> 32; }
+
+SessionManager::SessionManager() : running(false), nextShard(0), tickHz(60)
+{
+}
+
+SessionManager::~SessionManager()
+{
+	stop();
+}
+
+bool SessionManager::start(const std::vector<LevelEntry> &entries, int count, int hz)
+{
+	stop();
+	if (entries.empty() || hz <= 0)
+		return false;
+	manifest = entries;
+	cache.assign(manifest.size(), std::shared_ptr<const Level>());
+	failed.assign(manifest.size(), false);
+	if (count <= 0)
+		count = std::max(1u, std::thread::hardware_concurrency());
+	count = std::min(count, SESSION_MAX_SHARDS);
+	tickHz = hz;
+	windowStart = Clock::now();
+	running = true;
+	shards.clear();
+	for (int i=0; i<count; i++)
+	{
+		shards.emplace_back(new Shard);
+		Shard &s = *shards.back();
+		s.index = i;
+		s.open = 0;
+		s.tickNs.reserve(SESSION_TICK_RING);
+		s.tickNext = 0;
+		s.ticks = s.inputs = s.dropped = s.overruns = s.busyNs = 0;
+	}
+	// Every shard exists before any thread looks at them
+	for (size_t i=0; i<shards.size(); i++)
+		shards[i]->thread = std::thread(&SessionManager::run, this, std::ref(*shards[i]));
+	return true;
+}
+
+void SessionManager::stop()
+{
+	if (!running)
+		return;
+	running = false;
+	for (size_t i=0; i<shards.size(); i++)
+		shards[i]->thread.join();
+	shards.clear();
+}
+
+std::shared_ptr<const Level> SessionManager::level(int index)
+{
+	if (index < 0 || index >= (int)manifest.size())
+		return std::shared_ptr<const Level>();
+	std::lock_guard<std::mutex> hold(cacheLock);
+	if (!cache[index] && !failed[index])
+	{
+		// Loaded under the lock: anyone else wanting it would wait anyway
+		std::shared_ptr<Level> loaded(new Level);
+		if (loadLevel(manifest[index], *loaded))
+			cache[index] = loaded;
+		else
+			failed[index] = true;
+	}
+	return cache[index];
+}
+
+SessionId SessionManager::open(int levelNumber)
+{
+	if (shards.empty() || !level(levelNumber-1))
+		return 0;
+	Shard &s = *shards[nextShard++ % shards.size()];
+	std::lock_guard<std::mutex> hold(s.lock);
+	uint32_t slot;
+	if (!s.freeSlots.empty())
+	{
+		slot = s.freeSlots.back();
+		s.freeSlots.pop_back();
+	}
+	else if (s.generation.size() < SESSION_MAX_SLOTS)
+	{
+		slot = s.generation.size();
+		s.generation.push_back(0);
+	}
+	else
+		return 0;
+	// Generations start at 1, so no id is 0
+	SessionId id = (SessionId)++s.generation[slot] << 32 | slot << 8 | s.index;
+	Command c = { id, SESSION_OPEN, levelNumber };
+	s.inbox.push_back(c);
+	s.open++;
+	return id;
+}
+
+void SessionManager::close(SessionId id)
+{
+	if (idShard(id) >= (int)shards.size())
+		return;
+	Shard &s = *shards[idShard(id)];
+	Command c = { id, SESSION_CLOSE, 0 };
+	std::lock_guard<std::mutex> hold(s.lock);
+	s.inbox.push_back(c);
+}
+
+void SessionManager::input(SessionId id, int dir)
+{
+	if (idShard(id) >= (int)shards.size() || (unsigned)dir > DIR_SWAP)
+		return;
+	Shard &s = *shards[idShard(id)];
+	Command c = { id, dir, 0 };
+	std::lock_guard<std::mutex> hold(s.lock);
+	s.inbox.push_back(c);
+}
+
+void SessionManager::poll(std::vector<SessionEvent> &out)
+{
+	for (size_t i=0; i<shards.size(); i++)
+	{
+		Shard &s = *shards[i];
+		std::lock_guard<std::mutex> hold(s.lock);
+		out.insert(out.end(), s.events.begin(), s.events.end());
+		s.events.clear();
+	}
+}
+
+SessionMetrics SessionManager::metrics(bool reset)
+{
+	SessionMetrics m = SessionMetrics();
+	m.shards = shards.size();
+	std::vector<uint32_t> times;
+	uint64_t busy = 0;
+	for (size_t i=0; i<shards.size(); i++)
+	{
+		Shard &s = *shards[i];
+		{
+			std::lock_guard<std::mutex> hold(s.lock);
+			m.sessions += s.open;
+		}
+		std::lock_guard<std::mutex> hold(s.statLock);
+		times.insert(times.end(), s.tickNs.begin(), s.tickNs.end());
+		m.ticks += s.ticks;
+		m.inputs += s.inputs;
+		m.dropped += s.dropped;
+		m.overruns += s.overruns;
+		busy += s.busyNs;
+		if (reset)
+		{
+			s.tickNs.clear();
+			s.tickNext = 0;
+			s.ticks = s.inputs = s.dropped = s.overruns = s.busyNs = 0;
+		}
+	}
+	Clock::time_point now = Clock::now();
+	double wall = std::chrono::duration<double, std::nano>(now - windowStart).count();
+	if (reset)
+		windowStart = now;
+	if (!times.empty())
+	{
+		// Nearest rank, as runquery does
+		std::sort(times.begin(), times.end());
+		size_t n = times.size();
+		m.p50 = times[(n*50 + 99)/100 - 1] / 1e3;
+		m.p90 = times[(n*90 + 99)/100 - 1] / 1e3;
+		m.p99 = times[(n*99 + 99)/100 - 1] / 1e3;
+		m.max = times[n-1] / 1e3;
+	}
+	if (wall > 0)
+		m.coresBusy = busy / wall;
+	if (m.coresBusy > 0)
+		m.sessionsPerCore = m.sessions / m.coresBusy;
+	return m;
+}
+
+void SessionManager::run(Shard &shard)
+{
+	Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / tickHz));
+	Clock::time_point next = Clock::now();
+	while (running)
+	{
+		next += period;
+		Clock::time_point begin = Clock::now();
+		tick(shard);
+		Clock::time_point end = Clock::now();
+		uint32_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+		{
+			std::lock_guard<std::mutex> hold(shard.statLock);
+			if (shard.tickNs.size() < SESSION_TICK_RING)
+				shard.tickNs.push_back(ns);
+			else
+				shard.tickNs[shard.tickNext] = ns;
+			shard.tickNext = (shard.tickNext + 1) % SESSION_TICK_RING;
+			shard.ticks++;
+			shard.busyNs += ns;
+			if (end > next)
+				shard.overruns++;
+		}
+		// A late tick starts the next at once, without trying to catch up
+		if (end > next)
+			next = end;
+		else
+			std::this_thread::sleep_until(next);
+	}
+}
+
+void SessionManager::tick(Shard &shard)
+{
+	shard.batch.clear();
+	{
+		std::lock_guard<std::mutex> hold(shard.lock);
+		shard.batch.swap(shard.inbox);
+		// Slots freed last tick are off the falling list by now
+		shard.freeSlots.insert(shard.freeSlots.end(), shard.freed.begin(), shard.freed.end());
+		shard.freed.clear();
+	}
+
+	uint64_t inputs = 0, dropped = 0;
+	for (size_t i=0; i<shard.batch.size(); i++)
+	{
+		const Command &c = shard.batch[i];
+		uint32_t slot = idSlot(c.id);
+		if (c.dir == SESSION_OPEN)
+		{
+			if (slot >= shard.sessions.size())
+				shard.sessions.resize(slot + 1);
+			Session &s = shard.sessions[slot];
+			s.generation = idGeneration(c.id);
+			s.live = true;
+			gameStart(s.game, level(c.level-1), c.level);
+			continue;
+		}
+		if (slot >= shard.sessions.size())
+		{
+			dropped++;
+			continue;
+		}
+		Session &s = shard.sessions[slot];
+		if (!s.live || s.generation != idGeneration(c.id))
+		{
+			dropped++;
+			continue;
+		}
+		if (c.dir == SESSION_CLOSE)
+			release(shard, slot, -1);
+		else if (c.dir == DIR_SWAP ? gameSwap(s.game) : gameRoll(s.game, c.dir))
+		{
+			inputs++;
+			if (s.game.falling)
+				shard.falling.push_back(slot);
+		}
+		else
+			dropped++;
+	}
+
+	float dt = 1.0f / tickHz;
+	for (size_t i=0; i<shard.falling.size(); )
+	{
+		uint32_t slot = shard.falling[i];
+		Session &s = shard.sessions[slot];
+		if (s.live && !gameFall(s.game, dt))
+		{
+			i++;
+			continue;
+		}
+		shard.falling[i] = shard.falling.back();
+		shard.falling.pop_back();
+		if (s.live)
+			endLevel(shard, slot);
+	}
+
+	std::lock_guard<std::mutex> hold(shard.statLock);
+	shard.inputs += inputs;
+	shard.dropped += dropped;
+}
+
+/* The fall into the goal or off the board has finished */
+void SessionManager::endLevel(Shard &shard, uint32_t slot)
+{
+	Session &s = shard.sessions[slot];
+	GameState &game = s.game;
+	if (!game.won)
+	{
+		release(shard, slot, SESSION_FELL);
+		return;
+	}
+	std::shared_ptr<const Level> next = level(game.level);
+	if (!next)
+	{
+		release(shard, slot, SESSION_FINISHED);
+		return;
+	}
+	SessionEvent e = { (SessionId)s.generation << 32 | slot << 8 | shard.index, SESSION_LEVEL_WON, game.level, game.moves() };
+	{
+		std::lock_guard<std::mutex> hold(shard.lock);
+		shard.events.push_back(e);
+	}
+	gameStart(game, next, game.level + 1);
+}
+
+/* End the session in slot, with an event of kind unless it is -1 */
+void SessionManager::release(Shard &shard, uint32_t slot, int kind)
+{
+	Session &s = shard.sessions[slot];
+	s.live = false;
+	std::lock_guard<std::mutex> hold(shard.lock);
+	if (kind >= 0)
+	{
+		SessionEvent e = { (SessionId)s.generation << 32 | slot << 8 | shard.index, kind, s.game.level, s.game.moves() };
+		shard.events.push_back(e);
+	}
+	shard.freed.push_back(slot);
+	shard.open--;
+	// Drops the board reference and the move log
+	s.game = GameState();
+}
@@ -0,0 +1,134 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include "level.h"
+#include "game.h"
+
+/* Many player sessions in one process, for a game server.
+ *
+ * Sessions are sharded over worker threads that each run a fixed tick.
+ * Input is queued from any thread and applied in one batch per tick; every
+ * session on a level plays on the same compiled Level, loaded once. A fall
+ * ends the session and a win moves it to the next manifest level. */
+
+/* Low 8 bits shard, next 24 slot, high 32 generation of the slot */
+typedef uint64_t SessionId;
+#define SESSION_MAX_SHARDS 256
+#define SESSION_MAX_SLOTS (1 << 24)
+
+enum SessionEventKind {
+	SESSION_LEVEL_WON,		// level is the one just won; the next starts at once
+	SESSION_FELL,			// the session is over
+	SESSION_FINISHED		// won the last level; the session is over
+};
+
+struct SessionEvent {
+	SessionId id;
+	int kind;
+	int level;
+	int moves;
+};
+
+struct SessionMetrics {
+	int shards;
+	int sessions;			// open at the time of the call
+	uint64_t ticks;			// summed over shards since the last reset
+	uint64_t inputs;		// moves applied
+	uint64_t dropped;		// moves for closed sessions or while falling
+	uint64_t overruns;		// ticks that took longer than the tick period
+	/* Tick processing time over every shard, microseconds */
+	double p50, p90, p99, max;
+	double coresBusy;		// ticking time / wall time, in cores
+	double sessionsPerCore;	// sessions / coresBusy
+};
+
+class SessionManager {
+public:
+	SessionManager();
+	~SessionManager();
+	/* Starts shards worker threads (0 for the hardware thread count)
+	 * ticking tickHz times a second over the manifest levels */
+	bool start(const std::vector<LevelEntry> &manifest, int shards = 0, int tickHz = 60);
+	void stop();
+
+	/* A new session on level (from 1). It starts playing at its shard's
+	 * next tick; returns 0 if the level can't be loaded or the shard is full. */
+	SessionId open(int level = 1);
+	void close(SessionId id);
+	/* Queue a DIR_* roll, or DIR_SWAP, for the next tick */
+	void input(SessionId id, int dir);
+
+	/* Moves events since the last call onto the end of out */
+	void poll(std::vector<SessionEvent> &out);
+	/* Metrics since the last reset; reset starts a new window */
+	SessionMetrics metrics(bool reset = false);
+
+	/* Compiled level index (from 0), loaded on first use and shared by
+	 * every session playing it; NULL if it doesn't load */
+	std::shared_ptr<const Level> level(int index);
+	int levelCount() const { return manifest.size(); }
+
+private:
+	SessionManager(const SessionManager&);
+	SessionManager& operator=(const SessionManager&);
+
+	struct Session {
+		GameState game;
+		uint32_t generation;
+		bool live;
+		Session() : generation(0), live(false) {}
+	};
+	struct Command {
+		SessionId id;
+		int dir;		// DIR_*, or SESSION_OPEN / SESSION_CLOSE
+		int level;		// SESSION_OPEN: manifest position
+	};
+	/* Written by its thread only, except inbox, freeSlots and generation
+	 * (under lock) and the metrics (under statLock) */
+	struct Shard {
+		int index;
+		std::thread thread;
+		std::mutex lock;
+		std::vector<Command> inbox;		// swapped out whole each tick
+		std::vector<SessionEvent> events;
+		std::vector<uint32_t> freeSlots;
+		std::vector<uint32_t> generation;
+		std::vector<uint32_t> freed;	// released this tick, reusable from the next
+		int open;
+
+		std::vector<Session> sessions;
+		std::vector<uint32_t> falling;	// slots with a fall in progress
+		std::vector<Command> batch;
+
+		std::mutex statLock;
+		std::vector<uint32_t> tickNs;	// ring of recent tick times
+		size_t tickNext;
+		uint64_t ticks, inputs, dropped, overruns, busyNs;
+	};
+
+	void run(Shard &shard);
+	void tick(Shard &shard);
+	void endLevel(Shard &shard, uint32_t slot);
+	void release(Shard &shard, uint32_t slot, int kind);
+
+	std::vector<LevelEntry> manifest;
+	std::mutex cacheLock;
+	std::vector<std::shared_ptr<const Level> > cache;
+	std::vector<bool> failed;
+
+	std::vector<std::unique_ptr<Shard> > shards;
+	std::atomic<bool> running;
+	std::atomic<uint32_t> nextShard;
+	int tickHz;
+	std::chrono::steady_clock::time_point windowStart;
+};
+
+#endif
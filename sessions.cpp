@@ -0,0 +1,174 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <unordered_map>
+#include <random>
+#include <chrono>
+#include <thread>
+
+#include "level.h"
+#include "solver.h"
+#include "session.h"
+
+/* Load test for the session manager: keeps N simulated players connected
+ * and prints its metrics once a second.
+ *
+ *   sessions [-n sessions] [-t shards] [-r tick Hz] [-i moves/s] [-e error rate]
+ *            [-d seconds] [-m manifest]
+ *
+ * Players press keys at human speed, following each level's optimal
+ * solution but rolling a random way instead with the error rate. A player
+ * whose session ends (fell or finished the manifest) starts a new one on
+ * level 1, so the number of sessions stays at N. */
+
+typedef std::chrono::steady_clock Clock;
+
+/* How often the players get to press keys */
+#define DRIVER_HZ 100
+
+struct Player {
+	SessionId id;
+	int level;			// manifest index being played
+	size_t step;		// next move of the level's solution
+	double nextMove;	// seconds since the start
+};
+
+static void report(const SessionMetrics &m, double seconds)
+{
+	printf("sessions %d shards %d ticks/s %.0f moves/s %.0f dropped/s %.0f"
+		" tick us p50 %.1f p90 %.1f p99 %.1f max %.1f cores %.2f sessions/core %.0f overruns %llu\n",
+		m.sessions, m.shards, m.ticks/seconds, m.inputs/seconds, m.dropped/seconds,
+		m.p50, m.p90, m.p99, m.max, m.coresBusy, m.sessionsPerCore, (unsigned long long)m.overruns);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+	int count = 10000, shards = 0, tickHz = 60;
+	double rate = 3, errors = 0.02, duration = 10;
+	const char *manifestPath = "manifest.txt";
+	for (int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-n") && i+1 < argc)
+			count = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-t") && i+1 < argc)
+			shards = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-r") && i+1 < argc)
+			tickHz = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-i") && i+1 < argc)
+			rate = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-e") && i+1 < argc)
+			errors = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-d") && i+1 < argc)
+			duration = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-m") && i+1 < argc)
+			manifestPath = argv[++i];
+		else
+		{
+			fprintf(stderr, "usage: sessions [-n sessions] [-t shards] [-r tick Hz] [-i moves/s] [-e error rate]\n"
+				"                [-d seconds] [-m manifest]\n");
+			return 2;
+		}
+	}
+	if (count <= 0 || tickHz <= 0 || rate <= 0)
+		return 2;
+
+	std::vector<LevelEntry> manifest;
+	if (!loadManifest(manifestPath, manifest))
+		defaultManifest(manifest);
+	SessionManager manager;
+	if (!manager.start(manifest, shards, tickHz))
+		return 1;
+	// The players' plans; the manager loads its own copies only once too
+	std::vector<std::vector<int> > solutions(manifest.size());
+	for (size_t i=0; i<manifest.size(); i++)
+	{
+		std::shared_ptr<const Level> level = manager.level(i);
+		if (!level || solveLevel(*level, &solutions[i]) < 0)
+		{
+			fprintf(stderr, "%s: can't be loaded or won\n", manifest[i].file.c_str());
+			return 1;
+		}
+	}
+
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> uniform(0, 1);
+	std::exponential_distribution<double> gap(rate);
+	std::vector<Player> players(count);
+	std::unordered_map<SessionId, int> byId;
+	for (int i=0; i<count; i++)
+	{
+		Player &p = players[i];
+		p.id = manager.open(1);
+		p.level = 0;
+		p.step = 0;
+		p.nextMove = gap(rng);
+		byId[p.id] = i;
+	}
+
+	Clock::time_point start = Clock::now(), nextReport = start + std::chrono::seconds(1);
+	Clock::time_point next = start, last = start;
+	manager.metrics(true);
+	std::vector<SessionEvent> events;
+	uint64_t won = 0, fell = 0, finished = 0;
+	for (;;)
+	{
+		next += std::chrono::microseconds(1000000 / DRIVER_HZ);
+		std::this_thread::sleep_until(next);
+		Clock::time_point now = Clock::now();
+		double t = std::chrono::duration<double>(now - start).count();
+		if (t >= duration)
+			break;
+
+		events.clear();
+		manager.poll(events);
+		for (size_t i=0; i<events.size(); i++)
+		{
+			const SessionEvent &e = events[i];
+			std::unordered_map<SessionId, int>::iterator it = byId.find(e.id);
+			if (it == byId.end())
+				continue;
+			Player &p = players[it->second];
+			p.step = 0;
+			if (e.kind == SESSION_LEVEL_WON)
+			{
+				won++;
+				p.level = e.level;	// the next level, from 0
+				continue;
+			}
+			e.kind == SESSION_FELL ? fell++ : finished++;
+			byId.erase(it);
+			p.id = manager.open(1);
+			p.level = 0;
+			byId[p.id] = &p - &players[0];
+		}
+
+		for (int i=0; i<count; i++)
+		{
+			Player &p = players[i];
+			if (p.nextMove > t)
+				continue;
+			p.nextMove = t + gap(rng);
+			const std::vector<int> &plan = solutions[p.level];
+			// Waiting for the fall into the goal to finish
+			if (p.step >= plan.size())
+				continue;
+			int dir = plan[p.step++];
+			if (uniform(rng) < errors)
+				dir = rng() % 4;
+			manager.input(p.id, dir);
+		}
+
+		if (now >= nextReport)
+		{
+			report(manager.metrics(true), std::chrono::duration<double>(now - last).count());
+			last = now;
+			nextReport += std::chrono::seconds(1);
+		}
+	}
+	printf("levels won %llu fell %llu finished %llu\n",
+		(unsigned long long)won, (unsigned long long)fell, (unsigned long long)finished);
+	manager.stop();
+	return 0;
+}
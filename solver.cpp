@@ -0,0 +1,183 @@
+#include <algorithm>
+
+#include "solver.h"
+
+int solveLevel(const Level &level, std::vector<int> *path)
+{
+	if (path)
+		path->clear();
+	int states = stateCount(level);
+	if (states == 0 || level.next.empty() || !level.isLive(startState(level)))
+		return -1;
+
+	// parent[s] is the state s was first reached from, by rolling in via[s]
+	// or by DIR_SWAP from its twin; via is 6 for unseen states and 7 for the start
+	std::vector<StateKey> parent(states);
+	std::vector<uint8_t> via(states, 6);
+	std::vector<StateKey> queue;
+	queue.reserve(1024);
+	StateKey start = startState(level);
+	via[start] = 7;
+	queue.push_back(start);
+	bool splits = !level.splits.empty();
+
+	size_t head = 0, layerEnd = 1;
+	int depth = 0;
+	while (head < queue.size())
+	{
+		StateKey key = queue[head++];
+		for (int dir=0; dir<4; dir++)
+		{
+			StateKey to;
+			int result = stepState(level, key, dir, &to);
+			if (result == REST_FALL)
+				continue;
+			if (result == REST_WIN)
+			{
+				if (path)
+				{
+					path->push_back(dir);
+					for (StateKey s = key; via[s] <= DIR_SWAP; s = parent[s])
+						path->push_back(via[s]);
+					std::reverse(path->begin(), path->end());
+				}
+				return depth + 1;
+			}
+			// Dead states can't be on a solution; compileLevel marked them
+			if (via[to] != 6 || !level.isLive(to))
+				continue;
+			parent[to] = key;
+			via[to] = dir;
+			queue.push_back(to);
+			// Handing over to the other cube is free, so its twin is in the same layer
+			StateKey twin = splits ? swapState(level, to) : to;
+			if (twin != to)
+			{
+				parent[twin] = to;
+				via[twin] = DIR_SWAP;
+				queue.push_back(twin);
+			}
+		}
+		if (head == layerEnd)
+		{
+			depth++;
+			layerEnd = queue.size();
+		}
+	}
+	return -1;
+}
+
+/* Whether a roll from pose can end standing on a goal; nothing else wins */
+static bool mayWin(const Level &level, int pose, int dir)
+{
+	int next = level.next[(size_t)pose*4 + dir];
+	return next >= 0 && next < level.wholePoses() && next % 3 == 0
+		&& tileKinds[level.cells[next / 3]].trigger == TRIGGER_GOAL;
+}
+
+void solveStats(const Level &level, SolveStats &stats, bool distances)
+{
+	stats.optimal = -1;
+	stats.solutions.set(0);
+	stats.reachable = 0;
+	stats.distances.clear();
+	int states = stateCount(level);
+	if (states == 0 || level.next.empty())
+		return;
+	// Dead states add nothing to the count; the distances need them all
+	bool prune = !distances;
+	if (prune && !level.isLive(startState(level)))
+		return;
+
+	// Counts are kept by queue position, which is also BFS order
+	std::vector<int32_t> &seen = stats.seen;
+	std::vector<StateKey> &queue = stats.queue;
+	WideCounts &ways = stats.ways;
+	seen.assign(states, -1);
+	queue.clear();
+	ways.reset(256);
+	StateKey start = startState(level);
+	seen[start] = 0;
+	queue.push_back(start);
+	ways.set(0, 1);
+	bool splits = !level.splits.empty();
+	// Wins are summed in 64 bits while they fit, saving a WideCount each.
+	// optimal stays local: stats' vectors could alias it for the compiler.
+	uint64_t wins = 0;
+	int optimal = -1;
+
+	size_t head = 0, layerStart = 0, layerEnd = 1;
+	int depth = 0;
+	while (head < queue.size())
+	{
+		int from = head;
+		StateKey key = queue[head++];
+		// Once the optimal layer is known the rest of it is only checked for wins
+		bool winsOnly = optimal >= 0 && !distances;
+		for (int dir=0; dir<4; dir++)
+		{
+			if (winsOnly && !mayWin(level, statePose(level, key), dir))
+				continue;
+			StateKey to;
+			int result = stepState(level, key, dir, &to);
+			if (result == REST_FALL)
+				continue;
+			if (result == REST_WIN)
+			{
+				if (optimal < 0)
+					optimal = depth + 1;
+				if (optimal == depth + 1)
+				{
+					if (ways.limbs() == 1 && wins + ways.low(from) >= wins)
+						wins += ways.low(from);
+					else
+						stats.solutions.add(ways.get(from));
+				}
+				continue;
+			}
+			// Past the optimal layer only wins still count
+			if (optimal >= 0 && !distances)
+				continue;
+			int at = seen[to];
+			if (at < 0 && prune && !level.isLive(to))
+				continue;
+			// A split block's twin counts the same ways in: moving either cube
+			// next from there is another move of the same position
+			StateKey twin = splits ? swapState(level, to) : to;
+			if (at < 0)
+			{
+				at = seen[to] = queue.size();
+				queue.push_back(to);
+				if (twin != to)
+				{
+					seen[twin] = queue.size();
+					queue.push_back(twin);
+				}
+				if (queue.size() > ways.size())
+					ways.grow(queue.size() * 2);
+				ways.copy(at, from);
+				if (twin != to)
+					ways.copy(at + 1, from);
+			}
+			else if (at >= (int)layerEnd)
+			{
+				ways.add(at, from);		// another shortest way into the next layer
+				if (twin != to)
+					ways.add(seen[twin], from);
+			}
+		}
+		if (head == layerEnd)
+		{
+			if (distances)
+				stats.distances.push_back(layerEnd - layerStart);
+			else if (optimal >= 0)
+				break;
+			depth++;
+			layerStart = layerEnd;
+			layerEnd = queue.size();
+		}
+	}
+	stats.optimal = optimal;
+	stats.solutions.add(wins);
+	stats.reachable = queue.size();
+}
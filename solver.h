@@ -0,0 +1,38 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <vector>
+
+#include "level.h"
+#include "rules.h"
+#include "wide.h"
+
+/* Breadth-first search over StateKeys from the start state. Returns the
+ * optimal number of moves, or -1 if the level can't be won. If path is
+ * given it receives the directions (DIR_*) of one optimal solution, with
+ * a DIR_SWAP, which isn't a move, wherever the other cube of a split block
+ * takes over. Only the live states compileLevel() found are searched. */
+int solveLevel(const Level &level, std::vector<int> *path = NULL);
+
+struct SolveStats {
+	int optimal;				// -1 if the level can't be won
+	WideCount solutions;		// distinct optimal move sequences; a move of a split block is a cube and a direction
+	int reachable;				// states searched: all reachable ones with distances, else the live ones
+	/* distances[d]: reachable states d moves from the start */
+	std::vector<int> distances;
+
+	/* The search's own buffers, kept between calls to save reallocating
+	 * them */
+	std::vector<int32_t> seen;
+	std::vector<StateKey> queue;
+	WideCounts ways;
+};
+
+/* The same search, also counting the shortest paths into every state as
+ * each layer is expanded; a layer's counts are final before the next one
+ * starts. Stops once the optimal layer is done unless distances is
+ * wanted, which needs every reachable state; otherwise dead states are
+ * skipped like solveLevel() does. */
+void solveStats(const Level &level, SolveStats &stats, bool distances);
+
+#endif
@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+
+#include "feed.h"
+
+/* Follows a game started with --spectate from another process.
+ *
+ *   spectate [-i ms] [-1] [name]
+ *
+ * Polls the shared-memory feed every -i milliseconds (10) and prints a line
+ * whenever the game published something new, until the game exits. -1
+ * prints the current state once, waiting for the game's first tick if
+ * it hasn't published anything yet. Polling is plain loads from the mapping:
+ * no system calls, and nothing the game ever waits for. */
+
+static const char *orientationNames[] = { "standing", "lying x", "lying y", "split" };
+
+static void print(const SpectateState &s)
+{
+	char other[32] = "";
+	if (s.orientation == 3)
+		snprintf(other, sizeof(other), " %d,%d", s.row2 + 1, s.col2 + 1);
+	printf("%10.3f  level %u  %d,%d %s%s  mask %x  moves %u  board %u%s%s%s\n", s.time / 1e9, s.level,
+		s.row + 1, s.col + 1, s.orientation < 4 ? orientationNames[s.orientation] : "?", other, s.mask, s.moves,
+		s.boardVersion, s.flags & FEED_FALLING ? (s.flags & FEED_WON ? "  won" : "  falling") : "",
+		s.flags & FEED_OVER ? "  over" : "", s.flags & FEED_CLOSED ? "  closed" : "");
+	fflush(stdout);
+}
+
+static void usage()
+{
+	fprintf(stderr, "usage: spectate [-i ms] [-1] [name]\n");
+}
+
+int main(int argc, char **argv)
+{
+	int interval = 10;
+	bool once = false;
+	const char *name = FEED_DEFAULT_NAME;
+	for (int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-i") && i+1 < argc)
+			interval = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-1"))
+			once = true;
+		else if (argv[i][0] == '/')
+			name = argv[i];
+		else
+		{
+			usage();
+			return 2;
+		}
+	}
+	if (interval < 0)
+	{
+		usage();
+		return 2;
+	}
+
+	SpectateView view;
+	if (!view.open(name))
+		return 1;
+	SpectateState s;
+	uint32_t last = 0;		// nothing published yet
+	for (;;)
+	{
+		if (view.read(s) && s.seq != last)
+		{
+			last = s.seq;
+			print(s);
+			if (once || s.flags & FEED_CLOSED)
+				break;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+	}
+	return 0;
+}
@@ -0,0 +1,107 @@
+#ifndef STEAL_H
+#define STEAL_H
+
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+/* Runs tasks 0..count-1 over a set of threads for the tools whose tasks
+ * vary wildly in cost (a solver run can take microseconds or seconds).
+ * Every thread starts on an even share of the range and takes tasks from
+ * its front; one that runs dry steals the back half of the biggest share
+ * left, so no core idles while another has a queue. */
+class StealPool {
+public:
+	/* threads 0 picks the hardware thread count */
+	explicit StealPool(int threads = 0)
+	{
+		count = threads > 0 ? threads : std::max(1u, std::thread::hardware_concurrency());
+	}
+	int size() const { return count; }
+
+	/* fn(task, thread) for every task, thread in 0..size()-1 so callers can
+	 * keep per-thread scratch; returns once all have run */
+	template <class F>
+	void run(int tasks, F fn)
+	{
+		std::vector<Share> shares(count);
+		for (int i=0; i<count; i++)
+		{
+			shares[i].begin = (long long)tasks*i / count;
+			shares[i].end = (long long)tasks*(i+1) / count;
+		}
+		std::vector<std::thread> threads;
+		for (int i=1; i<count; i++)
+			threads.push_back(std::thread(&StealPool::work<F>, this, std::ref(shares), i, std::ref(fn)));
+		work(shares, 0, fn);
+		for (size_t i=0; i<threads.size(); i++)
+			threads[i].join();
+	}
+
+private:
+	struct alignas(64) Share {
+		std::mutex lock;
+		int begin, end;		// tasks not yet taken
+	};
+
+	template <class F>
+	void work(std::vector<Share> &shares, int self, F &fn)
+	{
+		Share &own = shares[self];
+		for (;;)
+		{
+			int task = -1;
+			{
+				std::lock_guard<std::mutex> hold(own.lock);
+				if (own.begin < own.end)
+					task = own.begin++;
+			}
+			if (task >= 0)
+				fn(task, self);
+			else if (!steal(shares, self))
+				return;
+		}
+	}
+
+	/* Move half of the biggest share into ours; false once there is nothing left */
+	bool steal(std::vector<Share> &shares, int self)
+	{
+		for (;;)
+		{
+			int victim = -1, most = 0;
+			for (int i=0; i<count; i++)
+			{
+				if (i == self)
+					continue;
+				// A stale size only picks a worse victim
+				std::lock_guard<std::mutex> hold(shares[i].lock);
+				if (shares[i].end - shares[i].begin > most)
+				{
+					most = shares[i].end - shares[i].begin;
+					victim = i;
+				}
+			}
+			if (victim < 0)
+				return false;
+			int begin, end;
+			{
+				std::lock_guard<std::mutex> hold(shares[victim].lock);
+				Share &v = shares[victim];
+				if (v.begin >= v.end)
+					continue;	// emptied meanwhile, look again
+				begin = v.begin + (v.end - v.begin) / 2;
+				end = v.end;
+				v.end = begin;
+			}
+			std::lock_guard<std::mutex> hold(shares[self].lock);
+			shares[self].begin = begin;
+			shares[self].end = end;
+			return true;
+		}
+	}
+
+	int count;
+};
+
+#endif
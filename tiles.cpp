@@ -0,0 +1,33 @@
+#include "tiles.h"
+
+const TileKind tileKinds[TILE_KINDS] = {
+	// name       glyphs  support            trigger         mesh
+	{ "empty",   "-",    SUPPORT_NONE,      TRIGGER_NONE,   MESH_NONE },
+	{ "solid",   "oS",   SUPPORT_ALWAYS,    TRIGGER_NONE,   MESH_SOLID },
+	{ "fragile", ".b",   SUPPORT_LYING,     TRIGGER_NONE,   MESH_FRAGILE },
+	{ "switch",  "s",    SUPPORT_ALWAYS,    TRIGGER_SWITCH, MESH_SWITCH },
+	{ "bridge",  "HB",   SUPPORT_EXTENDED,  TRIGGER_NONE,   MESH_BRIDGE },
+	{ "goal",    "T",    SUPPORT_ALWAYS,    TRIGGER_GOAL,   MESH_GOAL },
+	{ "hard switch", "h", SUPPORT_ALWAYS,   TRIGGER_HARD_SWITCH, MESH_SWITCH },
+	{ "split",   "x",    SUPPORT_ALWAYS,    TRIGGER_SPLIT,  MESH_SPLIT }
+};
+
+/* Reverse of the glyphs column, built once before main() */
+struct GlyphTable {
+	int8_t tile[256];
+
+	GlyphTable()
+	{
+		for (int c=0; c<256; c++)
+			tile[c] = -1;
+		for (int t=0; t<TILE_KINDS; t++)
+			for (const char *g = tileKinds[t].glyphs; *g; g++)
+				tile[(unsigned char)*g] = t;
+	}
+};
+static const GlyphTable glyphs;
+
+int glyphTile(int c)
+{
+	return glyphs.tile[c & 0xff];
+}
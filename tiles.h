@@ -0,0 +1,66 @@
+#ifndef TILES_H
+#define TILES_H
+
+#include <stdint.h>
+
+/* Tile kinds and how each behaves, in one table. The parser, the rules
+ * and the renderer all look tiles up here instead of testing types. */
+
+enum TileType {
+	TILE_EMPTY = 0,
+	TILE_SOLID = 1,
+	TILE_FRAGILE = 2,
+	TILE_SWITCH = 3,		// soft switch
+	TILE_BRIDGE = 4,
+	TILE_GOAL = 5,
+	TILE_HARD_SWITCH = 6,
+	TILE_SPLIT = 7,
+	TILE_KINDS
+};
+
+/* Whether the block can rest on the tile */
+enum SupportRule {
+	SUPPORT_NONE,		// falls
+	SUPPORT_ALWAYS,
+	SUPPORT_LYING,		// breaks under a standing block
+	SUPPORT_EXTENDED	// only while the tile's bridge group is extended
+};
+
+/* What the tile does when the block rests on it */
+enum TriggerRule {
+	TRIGGER_NONE,
+	TRIGGER_SWITCH,		// toggles its bridge groups under any part of the block
+	TRIGGER_HARD_SWITCH,	// toggles its bridge groups only under a standing block
+	TRIGGER_GOAL,		// wins when the block stands on it
+	TRIGGER_SPLIT		// splits a standing block into two cubes at its targets
+};
+
+/* Which tile mesh the renderer draws */
+enum TileMesh {
+	MESH_NONE,
+	MESH_SOLID,
+	MESH_FRAGILE,
+	MESH_SWITCH,
+	MESH_BRIDGE,
+	MESH_GOAL,
+	MESH_SPLIT,
+	MESH_COUNT
+};
+
+struct TileKind {
+	const char *name;
+	const char *glyphs;	// characters that stand for this tile in level files
+	uint8_t support;
+	uint8_t trigger;
+	uint8_t mesh;
+};
+
+extern const TileKind tileKinds[TILE_KINDS];
+
+/* Glyph that marks the start cell; it is also a solid tile */
+#define GLYPH_START 'S'
+
+/* TileType for a level file character, -1 if it isn't a tile */
+int glyphTile(int c);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef TRIPLE_H
+#define TRIPLE_H
+
+#include <atomic>
+
+/* Lock-free triple buffer for one writer and one reader thread.
+ * The writer fills back() and publish()es it; the reader calls update() and
+ * then reads front(). Each side owns one slot outright and the third is
+ * swapped through an atomic, so neither side ever waits and the reader
+ * always gets the newest complete value, skipping any it was too slow for. */
+template <class T>
+class TripleBuffer {
+public:
+	TripleBuffer() : middle(1), backIndex(2), frontIndex(0) {}
+
+	/* Writer side */
+	T &back() { return slots[backIndex]; }
+	void publish()
+	{
+		backIndex = middle.exchange(backIndex | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	/* Reader side. Returns true if a newer value was published since the last call. */
+	bool update()
+	{
+		if (!(middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		frontIndex = middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	const T &front() const { return slots[frontIndex]; }
+
+private:
+	enum { INDEX = 3, FRESH = 4 };
+
+	TripleBuffer(const TripleBuffer&);
+	TripleBuffer& operator=(const TripleBuffer&);
+
+	T slots[3];
+	alignas(64) std::atomic<int> middle;	// slot index | FRESH
+	alignas(64) int backIndex;				// writer only
+	alignas(64) int frontIndex;				// reader only
+};
+
+#endif
@@ -0,0 +1,492 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "level.h"
+#include "rules.h"
+#include "solver.h"
+
+/* Solution checker for the leaderboard: keeps the manifest's levels
+ * compiled and solved in memory and checks move strings against the same
+ * rules the game plays by.
+ *
+ *   verifyd [-m manifest] [-t threads] [socket]    serve (default bloxorz.sock)
+ *   verifyd -c [socket]                            send stdin, print replies
+ *
+ * Requests are lines of "<level> <moves>", level counting from 1 in
+ * manifest order and moves a string of U D L R (arrow keys), with S (Tab)
+ * where the other cube of a split block takes over; S isn't a move and
+ * does nothing to a whole block. Clients may send any number of lines
+ * without waiting; each gets one reply line, in order:
+ *
+ *   ok <moves> <gap>        won on the last move, gap = moves - optimal
+ *   fall <moves> -          fell (or broke a fragile tile) on that move
+ *   incomplete <moves> -    still on the board after the last move
+ *   trailing <moves> -      won on that move but more moves followed
+ *   invalid <moves> -       bad character at that position, or bad line
+ *   nolevel 0 -             no such level
+ *
+ * One thread runs an epoll loop over the listening socket and the clients.
+ * Whatever complete lines a client has sent go to the worker pool as one
+ * batch; a client has at most one batch out at a time, which keeps its
+ * replies in order while different clients are checked in parallel. A
+ * client that sends faster than it reads its replies stops being read
+ * until they drain, so its socket buffers fill and it has to wait. */
+
+/* A line longer than this gets the client disconnected */
+#define VERIFY_MAX_LINE 65536
+/* Requests or replies buffered past this hold the client's reading */
+#define VERIFY_MAX_BUFFER (1 << 20)
+
+struct Client {
+	int fd;
+	std::string in;		// bytes not yet handed to a worker
+	std::string out;	// replies not yet written
+	size_t outPos;
+	bool busy;			// a batch is with the workers
+	bool eof;			// peer finished sending
+	bool dead;			// socket closed, free once the batch is back
+};
+
+struct Batch {
+	Client *client;
+	std::string lines;
+	std::string replies;
+};
+
+static std::vector<Level> levels;
+static std::vector<int> optimal;
+
+static std::mutex lock;
+static std::condition_variable wake;
+static std::deque<Batch*> jobs, done;
+static bool quit;
+static int doneFd;
+static volatile sig_atomic_t stopping;
+
+static int moveDir(char c)
+{
+	switch (c) {
+		case 'U': case 'u': return DIR_UP;
+		case 'D': case 'd': return DIR_DOWN;
+		case 'L': case 'l': return DIR_LEFT;
+		case 'R': case 'r': return DIR_RIGHT;
+		case 'S': case 's': return DIR_SWAP;
+		default: return -1;
+	}
+}
+
+/* Check one request line (without its newline) and append the reply */
+static void verifyLine(const char *p, const char *end, std::string &reply)
+{
+	char buf[64];
+	while (p < end && *p == ' ')
+		p++;
+	long id = 0;
+	const char *digits = p;
+	while (p < end && *p >= '0' && *p <= '9' && id < 1000000)
+		id = id*10 + (*p++ - '0');
+	if (p == digits || (p < end && *p != ' '))
+	{
+		reply += "invalid 0 -\n";
+		return;
+	}
+	if (id < 1 || id > (long)levels.size())
+	{
+		reply += "nolevel 0 -\n";
+		return;
+	}
+	while (p < end && *p == ' ')
+		p++;
+	while (end > p && (end[-1] == ' ' || end[-1] == '\r'))
+		end--;
+
+	const Level &level = levels[id-1];
+	StateKey key = startState(level);
+	int moves = 0;
+	const char *verdict = "incomplete";
+	for (; p < end; p++)
+	{
+		int dir = moveDir(*p);
+		if (dir < 0)
+		{
+			moves++;
+			verdict = "invalid";
+			break;
+		}
+		if (dir == DIR_SWAP)
+		{
+			key = swapState(level, key);
+			continue;
+		}
+		moves++;
+		StateKey to;
+		int result = stepState(level, key, dir, &to);
+		if (result == REST_OK)
+		{
+			key = to;
+			continue;
+		}
+		verdict = result == REST_FALL ? "fall" : p+1 == end ? "ok" : "trailing";
+		break;
+	}
+	if (verdict[0] == 'o')
+		snprintf(buf, sizeof(buf), "ok %d %d\n", moves, moves - optimal[id-1]);
+	else
+		snprintf(buf, sizeof(buf), "%s %d -\n", verdict, moves);
+	reply += buf;
+}
+
+static void worker()
+{
+	for (;;)
+	{
+		Batch *b;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			while (!quit && jobs.empty())
+				wake.wait(guard);
+			if (quit)
+				return;
+			b = jobs.front();
+			jobs.pop_front();
+		}
+		const char *p = b->lines.data(), *end = p + b->lines.size();
+		while (p < end)
+		{
+			const char *nl = (const char*)memchr(p, '\n', end - p);
+			verifyLine(p, nl, b->replies);
+			p = nl + 1;
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			done.push_back(b);
+		}
+		uint64_t one = 1;
+		if (write(doneFd, &one, sizeof(one)) < 0)
+			perror("verifyd: eventfd");
+	}
+}
+
+/* Write as much of the client's replies as the socket takes */
+static void flush(Client *c)
+{
+	while (c->outPos < c->out.size())
+	{
+		ssize_t n = send(c->fd, c->out.data() + c->outPos, c->out.size() - c->outPos, MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno != EAGAIN && errno != EINTR)
+				c->dead = true;
+			if (errno != EINTR)
+				break;
+			continue;
+		}
+		c->outPos += n;
+	}
+	if (c->outPos == c->out.size())
+	{
+		c->out.clear();
+		c->outPos = 0;
+	}
+	else if (c->outPos > VERIFY_MAX_BUFFER)
+	{
+		// A reader that never quite catches up would keep the sent part forever
+		c->out.erase(0, c->outPos);
+		c->outPos = 0;
+	}
+}
+
+/* Hand the client's complete lines to the workers if it has none out and
+ * its replies so far aren't backed up */
+static void dispatch(Client *c)
+{
+	if (c->busy || c->dead || c->out.size() - c->outPos > VERIFY_MAX_BUFFER)
+		return;
+	size_t last = c->in.rfind('\n');
+	if (last == std::string::npos)
+	{
+		if (!c->eof || c->in.empty())
+		{
+			if (c->in.size() > VERIFY_MAX_LINE)
+				c->dead = true;
+			return;
+		}
+		c->in += '\n';	// last line without a newline
+		last = c->in.size() - 1;
+	}
+	Batch *b = new Batch;
+	b->client = c;
+	b->lines.assign(c->in, 0, last + 1);
+	c->in.erase(0, last + 1);
+	c->busy = true;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(b);
+	}
+	wake.notify_one();
+}
+
+/* Clients closed during this round of events. They are freed after it,
+ * since a later event of the same round may still point at them. */
+static std::vector<Client*> closed;
+
+/* Close the client when nothing is left to do for it */
+static void settle(Client *c)
+{
+	if (c->busy || c->fd < 0)
+		return;
+	if (!c->dead && !(c->eof && c->in.empty() && c->out.empty()))
+		return;
+	close(c->fd);
+	c->fd = -1;
+	closed.push_back(c);
+}
+
+/* Read while there is room for it, then dispatch. Called again whenever
+ * room may have been made, since edge-triggered epoll won't repeat what
+ * was left unread. */
+static void readClient(Client *c)
+{
+	char buf[65536];
+	while (c->in.size() < VERIFY_MAX_BUFFER && !c->eof)
+	{
+		ssize_t n = recv(c->fd, buf, sizeof(buf), 0);
+		if (n > 0)
+		{
+			c->in.append(buf, n);
+			continue;
+		}
+		if (n == 0)
+			c->eof = true;
+		else if (errno == EINTR)
+			continue;
+		else if (errno != EAGAIN)
+			c->dead = true;
+		break;
+	}
+	dispatch(c);
+}
+
+static void onStop(int)
+{
+	stopping = 1;
+}
+
+static int listenOn(const char *path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr.sun_path))
+	{
+		fprintf(stderr, "verifyd: socket path too long\n");
+		return -1;
+	}
+	strcpy(addr.sun_path, path);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		perror("verifyd: socket");
+		return -1;
+	}
+	unlink(path);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0)
+	{
+		perror("verifyd: bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int serve(const char *path, int threads)
+{
+	int listenFd = listenOn(path);
+	if (listenFd < 0)
+		return 1;
+	doneFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	int ep = epoll_create1(EPOLL_CLOEXEC);
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = &listenFd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, listenFd, &ev);
+	ev.data.ptr = &doneFd;
+	epoll_ctl(ep, EPOLL_CTL_ADD, doneFd, &ev);
+
+	signal(SIGINT, onStop);
+	signal(SIGTERM, onStop);
+	signal(SIGPIPE, SIG_IGN);
+
+	std::vector<std::thread> pool;
+	for (int t=0; t<threads; t++)
+		pool.push_back(std::thread(worker));
+	fprintf(stderr, "verifyd: %d levels on %s, %d workers\n", (int)levels.size(), path, threads);
+
+	struct epoll_event events[64];
+	while (!stopping)
+	{
+		int n = epoll_wait(ep, events, 64, -1);
+		for (int i=0; i<n; i++)
+		{
+			void *tag = events[i].data.ptr;
+			if (tag == &listenFd)
+			{
+				int fd;
+				while ((fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+				{
+					Client *c = new Client;
+					c->fd = fd;
+					c->outPos = 0;
+					c->busy = c->eof = c->dead = false;
+					ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+					ev.data.ptr = c;
+					epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+				}
+			}
+			else if (tag == &doneFd)
+			{
+				uint64_t count;
+				if (read(doneFd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+					perror("verifyd: eventfd");
+				std::deque<Batch*> finished;
+				{
+					std::lock_guard<std::mutex> guard(lock);
+					finished.swap(done);
+				}
+				for (size_t k=0; k<finished.size(); k++)
+				{
+					Batch *b = finished[k];
+					Client *c = b->client;
+					c->busy = false;
+					if (!c->dead && c->fd >= 0)
+					{
+						c->out += b->replies;
+						flush(c);
+						readClient(c);
+					}
+					delete b;
+					settle(c);
+				}
+			}
+			else
+			{
+				Client *c = (Client*)tag;
+				if (c->fd < 0)
+					continue;
+				if (events[i].events & (EPOLLERR | EPOLLHUP))
+					c->dead = true;
+				if (events[i].events & EPOLLOUT)
+					flush(c);
+				if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLOUT))
+					readClient(c);
+				settle(c);
+			}
+		}
+		for (size_t k=0; k<closed.size(); k++)
+			delete closed[k];
+		closed.clear();
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t t=0; t<pool.size(); t++)
+		pool[t].join();
+	unlink(path);
+	return 0;
+}
+
+/* Pipe stdin to the server and the replies to stdout */
+static int client(const char *path)
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		perror("verifyd: connect");
+		return 1;
+	}
+	std::thread reader([fd]() {
+		char buf[65536];
+		ssize_t n;
+		while ((n = read(fd, buf, sizeof(buf))) > 0)
+			fwrite(buf, 1, n, stdout);
+		fflush(stdout);
+	});
+	char buf[65536];
+	ssize_t n;
+	while ((n = read(0, buf, sizeof(buf))) > 0)
+		for (ssize_t off=0; off<n; )
+		{
+			ssize_t w = write(fd, buf + off, n - off);
+			if (w <= 0)
+				break;
+			off += w;
+		}
+	shutdown(fd, SHUT_WR);
+	reader.join();
+	close(fd);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *manifestPath = "manifest.txt";
+	const char *path = "bloxorz.sock";
+	int threads = std::thread::hardware_concurrency();
+	bool clientMode = false;
+	for (int i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-m") && i+1 < argc)
+			manifestPath = argv[++i];
+		else if (!strcmp(argv[i], "-t") && i+1 < argc)
+			threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-c"))
+			clientMode = true;
+		else if (argv[i][0] == '-')
+		{
+			fprintf(stderr, "usage: verifyd [-m manifest] [-t threads] [socket]\n"
+				"       verifyd -c [socket]\n");
+			return 2;
+		}
+		else
+			path = argv[i];
+	}
+	if (clientMode)
+		return client(path);
+	if (threads < 1)
+		threads = 1;
+
+	std::vector<LevelEntry> manifest;
+	if (!loadManifest(manifestPath, manifest))
+		defaultManifest(manifest);
+	levels.resize(manifest.size());
+	for (size_t i=0; i<manifest.size(); i++)
+	{
+		if (!loadLevel(manifest[i], levels[i]))
+			return 1;
+		optimal.push_back(solveLevel(levels[i]));
+	}
+	return serve(path, threads);
+}
@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+#include "watch.h"
+#include "pack.h"
+#include "solver.h"
+
+static std::string dirName(const std::string &path)
+{
+	size_t slash = path.rfind('/');
+	return slash == std::string::npos ? "." : path.substr(0, slash ? slash : 1);
+}
+
+static std::string baseName(const std::string &path)
+{
+	size_t slash = path.rfind('/');
+	return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+LevelWatcher::LevelWatcher(const std::vector<LevelEntry> &e)
+	: entries(e), inotifyFd(-1), current(0), ready(false), pendingOptimal(-1)
+{
+	stopPipe[0] = stopPipe[1] = -1;
+}
+
+LevelWatcher::~LevelWatcher()
+{
+	if (worker.joinable())
+	{
+		char c = 0;
+		if (write(stopPipe[1], &c, 1) < 0)
+			perror("watch");
+		worker.join();
+	}
+	if (inotifyFd >= 0)
+		close(inotifyFd);
+	if (stopPipe[0] >= 0)
+	{
+		close(stopPipe[0]);
+		close(stopPipe[1]);
+	}
+}
+
+bool LevelWatcher::start()
+{
+	inotifyFd = inotify_init1(IN_CLOEXEC);
+	if (inotifyFd < 0 || pipe(stopPipe) < 0)
+	{
+		perror("watch");
+		return false;
+	}
+	for (size_t i=0; i<entries.size(); i++)
+	{
+		std::string pack;
+		int index;
+		if (isPackEntry(entries[i].file, &pack, &index))
+			continue;
+		std::string dir = dirName(entries[i].file);
+		// Editors save by writing in place or by renaming a temp file over it
+		int wd = inotify_add_watch(inotifyFd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (wd < 0)
+		{
+			perror(dir.c_str());
+			continue;
+		}
+		if ((int)dirs.size() <= wd)
+			dirs.resize(wd + 1);
+		dirs[wd] = dir;
+	}
+	worker = std::thread(&LevelWatcher::run, this);
+	return true;
+}
+
+void LevelWatcher::setCurrent(int index)
+{
+	std::lock_guard<std::mutex> guard(lock);
+	current = index;
+}
+
+void LevelWatcher::run()
+{
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { stopPipe[0], POLLIN, 0 } };
+	for (;;)
+	{
+		if (::poll(fds, 2, -1) < 0)
+			continue;
+		if (fds[1].revents)
+			return;
+		ssize_t len = read(inotifyFd, buffer, sizeof(buffer));
+		if (len <= 0)
+			continue;
+		// Timed from here: the parse and solve are part of what a designer waits for
+		std::chrono::steady_clock::time_point saved = std::chrono::steady_clock::now();
+		std::string changed;
+		for (char *p = buffer; p < buffer + len; )
+		{
+			struct inotify_event *event = (struct inotify_event*)p;
+			p += sizeof(struct inotify_event) + event->len;
+			if (!event->len || event->wd >= (int)dirs.size())
+				continue;
+			std::string dir = dirs[event->wd];
+			changed = dir == "." ? std::string(event->name) : dir + "/" + event->name;
+			std::lock_guard<std::mutex> guard(lock);
+			const std::string &file = entries[current].file;
+			if (dirName(file) == dir && baseName(file) == event->name)
+				break;
+			changed.clear();
+		}
+		if (!changed.empty())
+			reload(changed, saved);
+	}
+}
+
+void LevelWatcher::reload(const std::string &file, std::chrono::steady_clock::time_point saved)
+{
+	LevelEntry entry;
+	int index;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		index = current;
+		entry = entries[index];
+	}
+	Level level;
+	// A half-finished edit that doesn't parse keeps the old level on screen
+	if (!loadLevel(entry, level))
+	{
+		fprintf(stderr, "%s: not reloaded\n", file.c_str());
+		return;
+	}
+	warnLevel(level, file.c_str());
+	int optimal = solveLevel(level);
+
+	std::lock_guard<std::mutex> guard(lock);
+	if (index != current)
+		return;
+	std::swap(pending, level);
+	pendingOptimal = optimal;
+	pendingSaved = saved;
+	ready.store(true, std::memory_order_release);
+}
+
+bool LevelWatcher::poll(Level &level, int *optimal, double *ms)
+{
+	if (!ready.load(std::memory_order_acquire))
+		return false;
+	std::lock_guard<std::mutex> guard(lock);
+	std::swap(level, pending);
+	*optimal = pendingOptimal;
+	*ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pendingSaved).count();
+	ready.store(false, std::memory_order_relaxed);
+	return true;
+}
@@ -0,0 +1,45 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+#include "level.h"
+
+/* Hot reload for level designers: watches the directories of the manifest's
+ * level files with inotify. When the current level's file is saved it is
+ * parsed, compiled and solved on the watcher thread, and the game picks the
+ * result up at its next tick with poll(). */
+class LevelWatcher {
+public:
+	LevelWatcher(const std::vector<LevelEntry> &entries);
+	~LevelWatcher();
+	bool start();
+	/* Manifest index of the level being played */
+	void setCurrent(int index);
+	/* Call once per tick. If a reload finished, swaps it into level and
+	 * returns true with its optimal move count (-1 if unsolvable) and the
+	 * time from inotify reporting the save to this swap in milliseconds. */
+	bool poll(Level &level, int *optimal, double *ms);
+private:
+	void run();
+	void reload(const std::string &file, std::chrono::steady_clock::time_point saved);
+
+	std::vector<LevelEntry> entries;
+	std::vector<std::string> dirs;	// watched directory per watch descriptor
+	int inotifyFd;
+	int stopPipe[2];
+	std::thread worker;
+	std::mutex lock;
+	int current;
+	std::atomic<bool> ready;
+	Level pending;
+	int pendingOptimal;
+	std::chrono::steady_clock::time_point pendingSaved;
+};
+
+#endif
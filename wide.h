@@ -0,0 +1,184 @@
+#ifndef WIDE_H
+#define WIDE_H
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/* Unsigned integers that don't overflow, for counting solutions: the number
+ * of shortest paths grows like 4^moves. */
+
+/* One number, as 64-bit limbs, least significant first */
+class WideCount {
+public:
+	WideCount(uint64_t v = 0) : limbs(1, v) {}
+	WideCount(const uint64_t *l, int n) : limbs(l, l + n) { trim(); }
+
+	void add(const WideCount &o)
+	{
+		if (o.limbs.size() > limbs.size())
+			limbs.resize(o.limbs.size(), 0);
+		uint64_t carry = 0;
+		for (size_t i=0; i<limbs.size(); i++)
+		{
+			uint64_t b = i < o.limbs.size() ? o.limbs[i] : 0;
+			uint64_t s = limbs[i] + b;
+			uint64_t c = s < b;
+			limbs[i] = s + carry;
+			carry = c | (limbs[i] < s);
+		}
+		if (carry)
+			limbs.push_back(carry);
+	}
+	/* The same for a plain number, and setting one, neither allocating
+	 * once there is a limb */
+	void add(uint64_t b)
+	{
+		for (size_t i=0; b && i<limbs.size(); i++)
+		{
+			limbs[i] += b;
+			b = limbs[i] < b;
+		}
+		if (b)
+			limbs.push_back(b);
+	}
+	void set(uint64_t v) { limbs.assign(1, v); }
+	bool zero() const { return limbs.size() == 1 && limbs[0] == 0; }
+	/* Fits in 64 bits */
+	bool small() const { return limbs.size() == 1; }
+	uint64_t low() const { return limbs[0]; }
+	double approx() const
+	{
+		double d = 0;
+		for (size_t i=limbs.size(); i-- > 0; )
+			d = d*18446744073709551616.0 + limbs[i];
+		return d;
+	}
+	/* Decimal */
+	std::string str() const
+	{
+		std::vector<uint64_t> n(limbs);
+		std::string digits;
+		// Peel off 19 decimal digits at a time, dividing by 10^19 with 32-bit halves
+		const uint64_t chunk = 10000000000000000000ull;
+		while (n.size() > 1 || n[0] >= chunk)
+		{
+			unsigned __int128 rem = 0;
+			for (size_t i=n.size(); i-- > 0; )
+			{
+				unsigned __int128 cur = rem << 64 | n[i];
+				n[i] = cur / chunk;
+				rem = cur % chunk;
+			}
+			while (n.size() > 1 && !n.back())
+				n.pop_back();
+			char part[24];
+			snprintf(part, sizeof(part), "%019llu", (unsigned long long)rem);
+			digits.insert(0, part);
+		}
+		char top[24];
+		snprintf(top, sizeof(top), "%llu", (unsigned long long)n[0]);
+		return top + digits;
+	}
+
+private:
+	void trim()
+	{
+		if (limbs.empty())
+			limbs.push_back(0);
+		while (limbs.size() > 1 && !limbs.back())
+			limbs.pop_back();
+	}
+	std::vector<uint64_t> limbs;
+};
+
+/* A count per state in one flat array with the same number of limbs for
+ * every state, starting at one and doubled whenever an addition carries
+ * out of the top, so the common case is a plain 64-bit add. */
+class WideCounts {
+public:
+	WideCounts() : count(0), width(1) {}
+	void reset(size_t n)
+	{
+		width = 1;
+		count = n;
+		v.assign(n, 0);
+	}
+	size_t size() const { return count; }
+	/* Room for n counts, keeping the ones there */
+	void grow(size_t n)
+	{
+		count = n;
+		v.resize(n*width, 0);
+	}
+	int limbs() const { return width; }
+
+	void set(size_t i, uint64_t value)
+	{
+		std::fill(&v[i*width], &v[i*width] + width, 0);
+		v[i*width] = value;
+	}
+	void copy(size_t to, size_t from)
+	{
+		if (width == 1)
+			v[to] = v[from];	// spares a memmove call per state
+		else
+			std::copy(&v[from*width], &v[from*width] + width, &v[to*width]);
+	}
+	void add(size_t to, size_t from)
+	{
+		if (width == 1)
+		{
+			uint64_t s = v[to] + v[from];
+			if (s >= v[from])
+			{
+				v[to] = s;
+				return;
+			}
+			widen();
+		}
+		while (!addWide(to, from))
+			widen();
+	}
+	WideCount get(size_t i) const { return WideCount(&v[i*width], width); }
+	/* The whole count while limbs() is 1, without building a WideCount */
+	uint64_t low(size_t i) const { return v[i*width]; }
+
+private:
+	/* False, leaving to unchanged, if the sum needs more limbs */
+	bool addWide(size_t to, size_t from)
+	{
+		uint64_t *a = &v[to*width];
+		const uint64_t *b = &v[from*width];
+		sum.resize(width);
+		uint64_t carry = 0;
+		for (int i=0; i<width; i++)
+		{
+			uint64_t s = a[i] + b[i];
+			uint64_t c = s < b[i];
+			sum[i] = s + carry;
+			carry = c | (sum[i] < s);
+		}
+		if (carry)
+			return false;
+		std::copy(sum.begin(), sum.end(), a);
+		return true;
+	}
+	void widen()
+	{
+		std::vector<uint64_t> wider(count * width * 2, 0);
+		for (size_t i=0; i<count; i++)
+			std::copy(&v[i*width], &v[i*width] + width, &wider[i*width*2]);
+		v.swap(wider);
+		width *= 2;
+	}
+
+	std::vector<uint64_t> v;
+	std::vector<uint64_t> sum;
+	size_t count;		// kept rather than divided out of v.size() on every check
+	int width;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#include <algorithm>
+
+#include "zobrist.h"
+
+uint64_t zobristKey(int kind, int row, int col)
+{
+	// splitmix64 finaliser over the packed feature
+	uint64_t z = ((uint64_t)kind << 48 | (uint64_t)row << 24 | (uint64_t)col) + 0x9e3779b97f4a7c15ull;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+uint64_t zobristHash(const Level &level)
+{
+	uint64_t h = zobristKey(ZOBRIST_SIZE, level.height, level.width);
+	for (int row=0; row<level.height; row++)
+		for (int col=0; col<level.width; col++)
+		{
+			int tile = level.cells[row*level.width + col];
+			if (tile != TILE_EMPTY)
+				h ^= zobristKey(tile, row, col);
+		}
+	h ^= zobristKey(ZOBRIST_START, level.startRow, level.startCol);
+	for (size_t i=0; i<level.bridges.size(); i++)
+	{
+		int cell = level.bridges[i].cell;
+		h ^= zobristKey(ZOBRIST_BRIDGE + level.bridges[i].group, cell / level.width, cell % level.width);
+	}
+	for (size_t i=0; i<level.switches.size(); i++)
+	{
+		int cell = level.switches[i].cell;
+		for (int g=0; g<LEVEL_MAX_GROUPS; g++)
+			if (level.switches[i].toggles & (1u << g))
+				h ^= zobristKey(ZOBRIST_SWITCH + g, cell / level.width, cell % level.width);
+	}
+	for (int g=0; g<LEVEL_MAX_GROUPS; g++)
+		if (level.startMask & (1u << g))
+			h ^= zobristKey(ZOBRIST_EXTENDED + g, 0, 0);
+	for (size_t i=0; i<level.splits.size(); i++)
+		for (int k=0; k<2; k++)
+			h ^= zobristKey(ZOBRIST_SPLIT + k, level.splits[i].cell, level.splits[i].cubes[k]);
+	return h;
+}
+
+/* Where the crop rows top..top+h, columns left..left+w of a level go under
+ * symmetry sym: bit 2 transposes, then bit 0 mirrors rows and bit 1 columns */
+struct Frame {
+	int width;			// of the source level
+	int top, left, h, w, sym;
+	int oh, ow;			// size after the symmetry
+
+	Frame(int width, int top, int left, int h, int w, int sym) : width(width), top(top), left(left), h(h), w(w), sym(sym)
+	{
+		oh = sym & 4 ? w : h;
+		ow = sym & 4 ? h : w;
+	}
+	void place(int r, int c, int *rr, int *cc) const
+	{
+		*rr = sym & 4 ? c : r;
+		*cc = sym & 4 ? r : c;
+		if (sym & 1)
+			*rr = oh-1 - *rr;
+		if (sym & 2)
+			*cc = ow-1 - *cc;
+	}
+	/* Source cell to cell after the symmetry */
+	int map(int cell) const
+	{
+		int rr, cc;
+		place(cell / width - top, cell % width - left, &rr, &cc);
+		return rr*ow + cc;
+	}
+};
+
+/* Number the groups in the order the new grid reaches their bridges;
+ * groups without bridges don't change play and are left at -1 */
+static void renumberGroups(const Level &level, const Frame &f, int renumber[LEVEL_MAX_GROUPS])
+{
+	std::fill(renumber, renumber + LEVEL_MAX_GROUPS, -1);
+	std::vector<std::pair<int, int> > order;	// new cell, group
+	order.reserve(level.bridges.size());
+	for (size_t i=0; i<level.bridges.size(); i++)
+		order.push_back(std::make_pair(f.map(level.bridges[i].cell), level.bridges[i].group));
+	std::sort(order.begin(), order.end());
+	int groups = 0;
+	for (size_t i=0; i<order.size(); i++)
+		if (renumber[order[i].second] < 0)
+			renumber[order[i].second] = groups++;
+}
+
+static uint32_t renumberMask(uint32_t mask, const int renumber[LEVEL_MAX_GROUPS])
+{
+	uint32_t out = 0;
+	for (int g=0; g<LEVEL_MAX_GROUPS; g++)
+		if (mask & (1u << g) && renumber[g] >= 0)
+			out |= 1u << renumber[g];
+	return out;
+}
+
+/* zobristHash() of what transform() would build, without building it */
+static uint64_t frameHash(const Level &level, const Frame &f)
+{
+	uint64_t h = zobristKey(ZOBRIST_SIZE, f.oh, f.ow);
+	for (int r=0; r<f.h; r++)
+		for (int c=0; c<f.w; c++)
+		{
+			int tile = level.cells[(f.top+r)*level.width + f.left+c];
+			if (tile == TILE_EMPTY)
+				continue;
+			int rr, cc;
+			f.place(r, c, &rr, &cc);
+			h ^= zobristKey(tile, rr, cc);
+		}
+	int start = f.map(level.startRow*level.width + level.startCol);
+	h ^= zobristKey(ZOBRIST_START, start / f.ow, start % f.ow);
+	for (size_t i=0; i<level.splits.size(); i++)
+		for (int k=0; k<2; k++)
+			h ^= zobristKey(ZOBRIST_SPLIT + k, f.map(level.splits[i].cell), f.map(level.splits[i].cubes[k]));
+	if (level.bridges.empty() && level.switches.empty())
+		return h;
+	int renumber[LEVEL_MAX_GROUPS];
+	renumberGroups(level, f, renumber);
+	for (size_t i=0; i<level.bridges.size(); i++)
+	{
+		int cell = f.map(level.bridges[i].cell);
+		h ^= zobristKey(ZOBRIST_BRIDGE + renumber[level.bridges[i].group], cell / f.ow, cell % f.ow);
+	}
+	for (size_t i=0; i<level.switches.size(); i++)
+	{
+		int cell = f.map(level.switches[i].cell);
+		uint32_t toggles = renumberMask(level.switches[i].toggles, renumber);
+		for (int g=0; g<LEVEL_MAX_GROUPS; g++)
+			if (toggles & (1u << g))
+				h ^= zobristKey(ZOBRIST_SWITCH + g, cell / f.ow, cell % f.ow);
+	}
+	uint32_t mask = renumberMask(level.startMask, renumber);
+	for (int g=0; g<LEVEL_MAX_GROUPS; g++)
+		if (mask & (1u << g))
+			h ^= zobristKey(ZOBRIST_EXTENDED + g, 0, 0);
+	return h;
+}
+
+static void transform(const Level &level, const Frame &f, Level &out)
+{
+	out = Level();
+	out.resize(f.ow, f.oh);
+	for (int r=0; r<f.h; r++)
+		for (int c=0; c<f.w; c++)
+		{
+			int rr, cc;
+			f.place(r, c, &rr, &cc);
+			out.cells[rr*f.ow + cc] = level.cells[(f.top+r)*level.width + f.left+c];
+		}
+	int start = f.map(level.startRow*level.width + level.startCol);
+	out.startRow = start / f.ow;
+	out.startCol = start % f.ow;
+	int renumber[LEVEL_MAX_GROUPS];
+	renumberGroups(level, f, renumber);
+	for (size_t i=0; i<level.bridges.size(); i++)
+		out.bridges.push_back(BridgeLink{f.map(level.bridges[i].cell), renumber[level.bridges[i].group]});
+	for (size_t i=0; i<level.switches.size(); i++)
+		out.switches.push_back(SwitchLink{f.map(level.switches[i].cell), renumberMask(level.switches[i].toggles, renumber)});
+	out.startMask = renumberMask(level.startMask, renumber);
+	for (size_t i=0; i<level.splits.size(); i++)
+		out.splits.push_back(SplitLink{f.map(level.splits[i].cell), {f.map(level.splits[i].cubes[0]), f.map(level.splits[i].cubes[1])}});
+	finishBindings(out);
+}
+
+uint64_t canonicalLevel(const Level &level, Level &out)
+{
+	int top = level.height, bottom = -1, left = level.width, right = -1;
+	for (int r=0; r<level.height; r++)
+		for (int c=0; c<level.width; c++)
+			if (level.cells[r*level.width + c] != TILE_EMPTY)
+			{
+				top = std::min(top, r);
+				bottom = std::max(bottom, r);
+				left = std::min(left, c);
+				right = std::max(right, c);
+			}
+	// A cube may be sent to an empty cell, where it falls; the crop keeps it
+	for (size_t i=0; i<level.splits.size() && bottom >= 0; i++)
+		for (int k=0; k<2; k++)
+		{
+			int r = level.splits[i].cubes[k] / level.width, c = level.splits[i].cubes[k] % level.width;
+			top = std::min(top, r);
+			bottom = std::max(bottom, r);
+			left = std::min(left, c);
+			right = std::max(right, c);
+		}
+	if (bottom < 0)
+	{
+		out = level;
+		return zobristHash(out);
+	}
+	// Only the winner is built
+	int bestSym = 0;
+	uint64_t best = 0;
+	for (int sym=0; sym<8; sym++)
+	{
+		uint64_t h = frameHash(level, Frame(level.width, top, left, bottom-top+1, right-left+1, sym));
+		if (sym == 0 || h < best)
+		{
+			best = h;
+			bestSym = sym;
+		}
+	}
+	transform(level, Frame(level.width, top, left, bottom-top+1, right-left+1, bestSym), out);
+	return best;
+}
+
+bool sameLevel(const Level &a, const Level &b)
+{
+	if (a.width != b.width || a.height != b.height || a.cells != b.cells || a.startRow != b.startRow
+		|| a.startCol != b.startCol || a.startMask != b.startMask
+		|| a.switches.size() != b.switches.size() || a.bridges.size() != b.bridges.size() || a.splits.size() != b.splits.size())
+		return false;
+	for (size_t i=0; i<a.switches.size(); i++)
+		if (a.switches[i].cell != b.switches[i].cell || a.switches[i].toggles != b.switches[i].toggles)
+			return false;
+	for (size_t i=0; i<a.bridges.size(); i++)
+		if (a.bridges[i].cell != b.bridges[i].cell || a.bridges[i].group != b.bridges[i].group)
+			return false;
+	for (size_t i=0; i<a.splits.size(); i++)
+		if (a.splits[i].cell != b.splits[i].cell || a.splits[i].cubes[0] != b.splits[i].cubes[0]
+			|| a.splits[i].cubes[1] != b.splits[i].cubes[1])
+			return false;
+	return true;
+}
@@ -0,0 +1,44 @@
+#ifndef ZOBRIST_H
+#define ZOBRIST_H
+
+#include <stdint.h>
+
+#include "level.h"
+
+/* Zobrist hashing of levels: the hash is the XOR of one random key per
+ * feature (a tile at a cell, the start cell, a bridge's group, a switch's
+ * toggles, a split tile's targets, the extended groups, the size), so changing one tile changes
+ * the hash by two XORs. Keys are computed from the feature rather than
+ * looked up, so any board size works and hashes are the same in every
+ * process.
+ *
+ * Two levels play the same when one is the other moved around the grid,
+ * rotated or mirrored (the roll rules have all eight symmetries of the
+ * square; lying along x and along y swap under a quarter turn), or with
+ * the bridge groups numbered differently. canonicalLevel() picks one
+ * representative of each such class. */
+
+/* Key of feature kind at (row, col); kinds are TileType, then the ZOBRIST_* below */
+uint64_t zobristKey(int kind, int row, int col);
+#define ZOBRIST_START TILE_KINDS
+#define ZOBRIST_SIZE (TILE_KINDS+1)
+#define ZOBRIST_BRIDGE (TILE_KINDS+2)						// + group
+#define ZOBRIST_SWITCH (ZOBRIST_BRIDGE + LEVEL_MAX_GROUPS)	// + group toggled
+#define ZOBRIST_EXTENDED (ZOBRIST_SWITCH + LEVEL_MAX_GROUPS)	// + group, at (0, 0)
+#define ZOBRIST_SPLIT (ZOBRIST_EXTENDED + LEVEL_MAX_GROUPS)	// + cube, at (split cell, target cell)
+
+/* Hash of the level as it is, position and group numbers included. The
+ * bindings must be complete (finishBindings, or a parsed or decoded level). */
+uint64_t zobristHash(const Level &level);
+
+/* Cropped to its tiles and split targets, turned to whichever of the eight symmetries hashes
+ * lowest, with bridge groups renumbered in the order their bridges appear
+ * and groups without bridges dropped; out is not compiled. Returns
+ * zobristHash(out). */
+uint64_t canonicalLevel(const Level &level, Level &out);
+
+/* Same board, start and bindings (compare canonical forms to ignore
+ * position and symmetry) */
+bool sameLevel(const Level &a, const Level &b);
+
+#endif